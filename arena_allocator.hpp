@@ -0,0 +1,146 @@
+#ifndef INC_201703_ARENA_ALLOCATOR_HPP
+#define INC_201703_ARENA_ALLOCATOR_HPP
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+
+namespace ds_exp
+{
+    inline namespace memory
+    {
+        // Bump allocator over a list of blocks. Single objects are never returned to it;
+        // all storage goes away at once when the arena is released or destroyed.
+        class node_arena
+        {
+        public:
+            static constexpr std::size_t initial_block_size = 4096;
+            static constexpr std::size_t max_block_size = std::size_t(1) << 20;
+
+            node_arena() = default;
+            node_arena(node_arena const &) = delete;
+            node_arena &operator=(node_arena const &) = delete;
+
+            void *allocate(std::size_t size, std::size_t alignment)
+            {
+                void *p = current;
+                std::size_t space = static_cast<std::size_t>(end - current);
+                if (!std::align(alignment, size, p, space))
+                {
+                    new_block(size + alignment);
+                    p = current;
+                    space = static_cast<std::size_t>(end - current);
+                    std::align(alignment, size, p, space);
+                }
+                current = static_cast<std::byte *>(p) + size;
+                return p;
+            }
+            // Makes sure the next `size` bytes can be handed out from a single block.
+            void reserve(std::size_t size)
+            {
+                if (static_cast<std::size_t>(end - current) < size)
+                    new_block(size);
+            }
+            void release()
+            {
+                blocks.clear();
+                current = end = nullptr;
+                next_block_size = initial_block_size;
+            }
+
+        private:
+            void new_block(std::size_t at_least)
+            {
+                auto size = std::max(next_block_size, at_least);
+                blocks.emplace_back(new std::byte[size]);
+                current = blocks.back().get();
+                end = current + size;
+                next_block_size = std::min(next_block_size * 2, max_block_size);
+            }
+
+            std::vector<std::unique_ptr<std::byte[]>> blocks;
+            std::byte *current = nullptr;
+            std::byte *end = nullptr;
+            std::size_t next_block_size = initial_block_size;
+        };
+
+        // Allocator handing out storage from a shared node_arena. Copies of a tree get an arena of
+        // their own, while subtrees split off a tree keep sharing the arena they were built in.
+        template <typename T>
+        class arena_allocator
+        {
+            template <typename>
+            friend class arena_allocator;
+
+        public:
+            using value_type = T;
+            using propagate_on_container_copy_assignment = std::true_type;
+            using propagate_on_container_move_assignment = std::true_type;
+            using propagate_on_container_swap = std::true_type;
+            using is_always_equal = std::false_type;
+            using releases_in_bulk = std::true_type;
+
+            arena_allocator()
+                : arena(std::make_shared<node_arena>())
+            {
+            }
+            // Moving shares the arena like copying does, so a container left behind by a move can still allocate.
+            arena_allocator(arena_allocator const &src) noexcept = default;
+            arena_allocator(arena_allocator &&src) noexcept
+                : arena(src.arena)
+            {
+            }
+            template <typename U>
+            arena_allocator(arena_allocator<U> const &src) noexcept
+                : arena(src.arena)
+            {
+            }
+            arena_allocator &operator=(arena_allocator const &src) noexcept = default;
+            arena_allocator &operator=(arena_allocator &&src) noexcept
+            {
+                arena = src.arena;
+                return *this;
+            }
+
+            T *allocate(std::size_t n)
+            {
+                return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T)));
+            }
+            void deallocate(T *, std::size_t) noexcept
+            {
+            }
+            void reserve(std::size_t n)
+            {
+                arena->reserve(n * sizeof(T) + alignof(T));
+            }
+            // Gives the blocks back only when no other allocator refers to the arena any more.
+            void release()
+            {
+                if (arena.use_count() == 1)
+                    arena->release();
+            }
+            arena_allocator select_on_container_copy_construction() const
+            {
+                return arena_allocator();
+            }
+
+            template <typename U>
+            friend bool operator==(arena_allocator const &lhs, arena_allocator<U> const &rhs)
+            {
+                return lhs.arena == rhs.arena;
+            }
+            template <typename U>
+            friend bool operator!=(arena_allocator const &lhs, arena_allocator<U> const &rhs)
+            {
+                return !(lhs == rhs);
+            }
+
+        private:
+            std::shared_ptr<node_arena> arena;
+        };
+    }
+}
+
+#endif //INC_201703_ARENA_ALLOCATOR_HPP
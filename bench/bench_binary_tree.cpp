@@ -0,0 +1,186 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../binary_tree.hpp"
+#include "../arena_allocator.hpp"
+#include "../compact_tree.hpp"
+#include "../frozen_tree.hpp"
+#include "../tree_parallel.hpp"
+#include "../tree_parse.hpp"
+#include "../save_load.hpp"
+#include "../structural_index.hpp"
+#include "../binary_format.hpp"
+#include "../mapped_tree.hpp"
+
+namespace
+{
+    using clock_type = std::chrono::steady_clock;
+
+    template <typename Callable>
+    double measure(Callable callable)
+    {
+        auto start = clock_type::now();
+        callable();
+        return std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+    }
+
+    void report(char const *layout, char const *phase, double ms)
+    {
+        std::cout << layout << "\t" << phase << "\t" << ms << " ms\n";
+    }
+
+    // Fills the tree level by level so that it is complete and n nodes large.
+    template <typename tree_type>
+    void build(tree_type &tree, std::size_t n)
+    {
+        using iter_type = decltype(tree.root());
+        tree.set_root(0);
+        std::vector<iter_type> level{tree.root()};
+        std::size_t count = 1;
+        for (std::size_t i = 0; count < n; ++i)
+        {
+            auto parent = level[i];
+            level.push_back(tree.new_child(parent, int(count++), ds_exp::left_child));
+            if (count < n)
+                level.push_back(tree.new_child(parent, int(count++), ds_exp::right_child));
+        }
+    }
+
+    template <typename tree_type>
+    void run(char const *layout, std::size_t n, std::string const &definition)
+    {
+        tree_type tree;
+        report(layout, "build", measure([&] { build(tree, n); }));
+        report(layout, "save", measure([&] {
+                   std::ostringstream stream;
+                   stream << tree;
+               }));
+        long long sum = 0;
+        report(layout, "preorder", measure([&] {
+                   for (auto value : ds_exp::tree_iterate(tree, ds_exp::preorder))
+                       sum += value;
+               }));
+        report(layout, "inorder", measure([&] {
+                   for (auto value : ds_exp::tree_iterate(tree, ds_exp::inorder))
+                       sum += value;
+               }));
+        report(layout, "morris inorder", measure([&] {
+                   ds_exp::morris_for_each(tree, [&sum](int value) { sum += value; }, ds_exp::inorder);
+               }));
+        report(layout, "level order queue", measure([&] {
+                   for (auto value : ds_exp::level_order(tree))
+                       sum += value;
+               }));
+        report(layout, "level order walk", measure([&] {
+                   for (auto value : ds_exp::tree_iterate(tree, ds_exp::levelorder))
+                       sum += value;
+               }));
+        report(layout, "parallel reduce", measure([&] {
+                   sum += ds_exp::parallel_reduce(tree, 0LL, std::plus<>(), [](int value) { return value; }, ds_exp::inorder);
+               }));
+        tree_type copy;
+        report(layout, "copy", measure([&] { copy = tree; }));
+        report(layout, "clear", measure([&] { tree.clear(); }));
+        report(layout, "destroy copy", measure([&] { copy = tree_type(); }));
+        report(layout, "parse", measure([&] {
+                   std::istringstream stream(definition);
+                   stream >> tree;
+               }));
+        report(layout, "clear parsed", measure([&] { tree.clear(); }));
+        std::string binary;
+        build(tree, n);
+        report(layout, "save binary", measure([&] {
+                   std::ostringstream stream;
+                   ds_exp::write_binary(stream, tree);
+                   binary = stream.str();
+               }));
+        tree.clear();
+        report(layout, "load binary", measure([&] {
+                   std::istringstream stream(binary);
+                   ds_exp::read_binary(stream, tree);
+               }));
+        {
+            std::ofstream file("bench.tree", std::ios::binary);
+            ds_exp::write_mapped(file, tree);
+        }
+        tree.clear();
+        report(layout, "map", measure([&] {
+                   ds_exp::mapped_tree<int> mapped("bench.tree");
+                   sum += *mapped.root();
+               }));
+        report(layout, "map and inorder", measure([&] {
+                   ds_exp::mapped_tree<int> mapped("bench.tree");
+                   for (auto value : ds_exp::tree_iterate(mapped, ds_exp::inorder))
+                       sum += value;
+               }));
+        std::remove("bench.tree");
+        report(layout, "parse buffer", measure([&] {
+                   using parse_type = ds_exp::buffer_parse<ds_exp::left_first_t, int, typename tree_type::allocator_type, typename tree_type::augment_type>;
+                   tree = parse_type(definition, tree.get_allocator()).get_binary_tree().value();
+               }));
+        tree.clear();
+        report(layout, "parse indexed", measure([&] {
+                   using parse_type = ds_exp::indexed_parse<ds_exp::left_first_t, int, typename tree_type::allocator_type, typename tree_type::augment_type>;
+                   tree = parse_type(definition, tree.get_allocator()).get_binary_tree().value();
+               }));
+        tree.clear();
+        std::vector<int> sorted(n);
+        std::iota(sorted.begin(), sorted.end(), 0);
+        report(layout, "from sorted", measure([&] { tree = tree_type::from_sorted(sorted.begin(), sorted.end()); }));
+        std::vector<int> pre(tree.begin(ds_exp::preorder), tree.end(ds_exp::preorder));
+        tree.clear();
+        report(layout, "from preorder inorder", measure([&] {
+                   tree = tree_type::from_preorder_inorder(pre.begin(), pre.end(), sorted.begin(), sorted.end());
+               }));
+        if (sum == 42)
+            std::cout << "";
+    }
+
+    template <typename tree_type>
+    void run_traversal(char const *layout, tree_type const &tree)
+    {
+        long long sum = 0;
+        report(layout, "preorder", measure([&] {
+                   for (auto value : ds_exp::tree_iterate(tree, ds_exp::preorder))
+                       sum += value;
+               }));
+        report(layout, "inorder", measure([&] {
+                   for (auto value : ds_exp::tree_iterate(tree, ds_exp::inorder))
+                       sum += value;
+               }));
+        if (sum == 42)
+            std::cout << "";
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    std::cout << "nodes: " << n << "\n";
+    ds_exp::binary_tree<int> source;
+    build(source, n);
+    std::ostringstream out;
+    out << source;
+    source.clear();
+    auto definition = out.str();
+    run<ds_exp::binary_tree<int>>("heap", n, definition);
+    run<ds_exp::binary_tree<int, ds_exp::arena_allocator<int>>>("arena", n, definition);
+    build(source, n);
+    ds_exp::compact_tree<int> compact;
+    report("compact", "convert", measure([&] { compact = ds_exp::compact_tree<int>(source); }));
+    run_traversal("compact", compact);
+    ds_exp::frozen_tree<int> frozen;
+    report("bfs", "freeze", measure([&] { frozen = ds_exp::freeze(source, ds_exp::bfs_layout); }));
+    run_traversal("bfs", frozen);
+    report("veb", "freeze", measure([&] { frozen = ds_exp::freeze(source, ds_exp::veb_layout); }));
+    run_traversal("veb", frozen);
+    source.clear();
+    return 0;
+}
@@ -0,0 +1,242 @@
+#ifndef INC_201703_BINARY_FORMAT_HPP
+#define INC_201703_BINARY_FORMAT_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include "binary_tree.hpp"
+#include "tree_parse.hpp"
+
+namespace ds_exp
+{
+    inline namespace tree
+    {
+        // Binary form of a tree, next to the text form of save_load.hpp. All integers are little endian.
+        //   header:  magic "\x89" "BTR", version (1 byte), node count (8 bytes), payload size (8 bytes),
+        //            payload checksum (4 bytes), checksum of the header bytes before it (4 bytes)
+        //   payload: the shape as 2 bits per node in preorder, whether the left and the right child exist,
+        //            padded to whole bytes, followed by the elements in preorder as written by put_binary.
+        // The magic starts with a byte no text definition starts with, so readers can tell the forms apart.
+        constexpr std::string_view binary_magic("\x89" "BTR", 4);
+        constexpr std::uint8_t binary_version = 1;
+        constexpr std::size_t binary_header_size = 29;
+
+        struct corrupt_data : std::domain_error
+        {
+            explicit corrupt_data(std::string const &what)
+                : domain_error("corrupt binary tree: " + what + ".")
+            {
+            }
+        };
+
+        namespace detail
+        {
+            // 32 bit FNV-1a, continuing from hash.
+            inline std::uint32_t checksum(std::string_view bytes, std::uint32_t hash = 2166136261u)
+            {
+                for (unsigned char c : bytes)
+                    hash = (hash ^ c) * 16777619u;
+                return hash;
+            }
+            inline void put_fixed(std::string &out, std::uint64_t value, std::size_t bytes)
+            {
+                for (std::size_t i = 0; i < bytes; ++i)
+                    out.push_back(char((value >> (8 * i)) & 0xff));
+            }
+            inline std::uint64_t get_fixed(std::string_view bytes)
+            {
+                std::uint64_t value = 0;
+                for (std::size_t i = 0; i < bytes.size(); ++i)
+                    value |= std::uint64_t(static_cast<unsigned char>(bytes[i])) << (8 * i);
+                return value;
+            }
+            inline void put_varint(std::string &out, std::uint64_t value)
+            {
+                for (; value >= 0x80; value >>= 7)
+                    out.push_back(char((value & 0x7f) | 0x80));
+                out.push_back(char(value));
+            }
+            inline std::uint64_t get_varint(std::string_view &in)
+            {
+                std::uint64_t value = 0;
+                for (int shift = 0; shift < 64; shift += 7)
+                {
+                    if (in.empty())
+                        throw corrupt_data("element cut off");
+                    auto byte = static_cast<unsigned char>(in.front());
+                    in.remove_prefix(1);
+                    value |= std::uint64_t(byte & 0x7f) << shift;
+                    if (!(byte & 0x80))
+                        return value;
+                }
+                throw corrupt_data("varint too long");
+            }
+            inline std::string_view get_bytes(std::string_view &in, std::uint64_t size)
+            {
+                if (size > in.size())
+                    throw corrupt_data("element cut off");
+                auto bytes = in.substr(0, std::size_t(size));
+                in.remove_prefix(std::size_t(size));
+                return bytes;
+            }
+        }
+
+        // Appends the binary form of one element. Text is written with its length in front, integers as zigzag
+        // varints and floating point numbers bit by bit; other types are written as the text operator<< prints.
+        // Types overload put_binary and get_binary next to themselves to use another form.
+        template <typename value>
+        void put_binary(std::string &out, value const &v)
+        {
+            if constexpr (std::is_convertible_v<value const &, std::string_view>)
+            {
+                std::string_view text = v;
+                detail::put_varint(out, text.size());
+                out.append(text);
+            }
+            else if constexpr (std::is_integral_v<value>)
+            {
+                auto bits = static_cast<std::uint64_t>(static_cast<std::int64_t>(v));
+                detail::put_varint(out, std::is_signed_v<value> ? (bits << 1) ^ (std::int64_t(bits) < 0 ? ~std::uint64_t(0) : 0) : bits);
+            }
+            else if constexpr (std::is_floating_point_v<value>)
+            {
+                static_assert(sizeof(value) <= 8, "put_binary handles floating point numbers of up to 8 bytes.");
+                std::uint64_t bits = 0;
+                std::memcpy(&bits, &v, sizeof(value));
+                detail::put_fixed(out, bits, sizeof(value));
+            }
+            else
+            {
+                std::ostringstream stream;
+                stream << v;
+                put_binary(out, stream.str());
+            }
+        }
+        // Reads one element written by put_binary from the front of in and removes it.
+        template <typename value>
+        void get_binary(std::string_view &in, value &v)
+        {
+            if constexpr (std::is_integral_v<value>)
+            {
+                auto bits = detail::get_varint(in);
+                if constexpr (std::is_signed_v<value>)
+                    bits = (bits >> 1) ^ (~(bits & 1) + 1);
+                v = static_cast<value>(bits);
+            }
+            else if constexpr (std::is_floating_point_v<value>)
+            {
+                auto bits = detail::get_fixed(detail::get_bytes(in, sizeof(value)));
+                std::memcpy(&v, &bits, sizeof(value));
+            }
+            else
+                assign_element(detail::get_bytes(in, detail::get_varint(in)), v);
+        }
+
+        // Writes tree in the binary form.
+        template <typename T, typename Allocator, typename Augment>
+        std::ostream &write_binary(std::ostream &out, binary_tree<T, Allocator, Augment> const &tree)
+        {
+            std::string shape, elements;
+            std::uint64_t count = 0;
+            for (auto iter = tree.begin(preorder); iter != tree.end(preorder); ++iter, ++count)
+            {
+                if (count % 4 == 0)
+                    shape.push_back(0);
+                auto bits = (iter.first_child() ? 1 : 0) | (iter.second_child() ? 2 : 0);
+                shape.back() = char(shape.back() | (bits << (count % 4 * 2)));
+                put_binary(elements, *iter);
+            }
+            std::string header(binary_magic);
+            header.push_back(char(binary_version));
+            detail::put_fixed(header, count, 8);
+            detail::put_fixed(header, shape.size() + elements.size(), 8);
+            detail::put_fixed(header, detail::checksum(elements, detail::checksum(shape)), 4);
+            detail::put_fixed(header, detail::checksum(header), 4);
+            return out << header << shape << elements;
+        }
+
+        // Reads a tree written by write_binary, checking the header and the payload. Throws corrupt_data if they
+        // don't fit together.
+        template <typename T, typename Allocator, typename Augment>
+        std::istream &read_binary(std::istream &in, binary_tree<T, Allocator, Augment> &tree)
+        {
+            std::string header(binary_header_size, '\0');
+            if (!in.read(header.data(), std::streamsize(header.size())))
+                throw corrupt_data("header cut off");
+            std::string_view fields = header;
+            if (fields.substr(0, 4) != binary_magic)
+                throw corrupt_data("wrong magic");
+            if (std::uint8_t(fields[4]) != binary_version)
+                throw corrupt_data("unknown version");
+            if (detail::get_fixed(fields.substr(25, 4)) != detail::checksum(fields.substr(0, 25)))
+                throw corrupt_data("header checksum mismatch");
+            auto count = detail::get_fixed(fields.substr(5, 8));
+            auto payload_size = detail::get_fixed(fields.substr(13, 8));
+            auto shape_size = count / 4 + (count % 4 != 0);
+            if (shape_size > payload_size)
+                throw corrupt_data("payload too small");
+            // Anyone can write a header that passes its checksum, so the payload is read in bounded chunks and
+            // grows only as far as the stream really goes.
+            constexpr std::uint64_t payload_chunk = 1 << 20;
+            std::string payload;
+            while (payload.size() < payload_size)
+            {
+                auto read = payload.size();
+                payload.resize(std::size_t(read + std::min(payload_chunk, payload_size - read)));
+                if (!in.read(payload.data() + read, std::streamsize(payload.size() - read)))
+                    throw corrupt_data("payload cut off");
+            }
+            std::string_view shape(payload.data(), std::size_t(shape_size)), elements(payload);
+            elements.remove_prefix(shape.size());
+            if (detail::checksum(payload) != detail::get_fixed(fields.substr(21, 4)))
+                throw corrupt_data("payload checksum mismatch");
+
+            using tree_type = binary_tree<T, Allocator, Augment>;
+            using iter_type = decltype(tree.root());
+            tree_type result(tree.get_allocator());
+            // The child slots still to fill, the next node in preorder goes into the last one.
+            std::vector<std::pair<iter_type, bool>> slots;
+            for (std::uint64_t i = 0; i < count; ++i)
+            {
+                if (i != 0 && slots.empty())
+                    throw corrupt_data("shape has more nodes than slots");
+                T value;
+                get_binary(elements, value);
+                auto current = [&] {
+                    if (i == 0)
+                        return result.set_root(std::move(value)), result.root();
+                    auto [parent, right] = slots.back();
+                    slots.pop_back();
+                    return right ? result.new_child(parent, std::move(value), right_child, defer_update)
+                                 : result.new_child(parent, std::move(value), left_child, defer_update);
+                }();
+                auto bits = static_cast<unsigned char>(shape[std::size_t(i / 4)]) >> (i % 4 * 2);
+                if (bits & 2)
+                    slots.emplace_back(current, true);
+                if (bits & 1)
+                    slots.emplace_back(current, false);
+            }
+            if (!slots.empty() || !elements.empty())
+                throw corrupt_data("shape and elements don't match");
+            result.update_augment();
+            tree = std::move(result);
+            return in;
+        }
+        // Whether the next non-space character of in starts the binary form.
+        inline bool binary_follows(std::istream &in)
+        {
+            in >> std::ws;
+            return in.peek() == std::char_traits<char>::to_int_type(binary_magic[0]);
+        }
+    }
+}
+
+#endif //INC_201703_BINARY_FORMAT_HPP
@@ -2,8 +2,19 @@
 #define INC_201703_BINARY_TREE_HPP
 
 #include <cstdlib>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <iterator>
 #include <memory>
 #include <cassert>
+#include <exception>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+#include <tuple>
+#include <vector>
+#include "parallel.hpp"
 
 namespace ds_exp
 {
@@ -27,21 +38,165 @@ namespace ds_exp
         constexpr right_first_t right_first;
         constexpr right_t right_child;
 
-        template <typename T>
-        struct node
+        // An augmentation keeps data in every node that is derived from the node and its children.
+        // update() recomputes it for one node and tells whether it changed, so fixing up the ancestors
+        // after a mutation can stop at the first node whose data stayed the same.
+        struct no_augment
+        {
+            template <typename Node>
+            struct data
+            {
+            };
+            template <typename Node>
+            static bool update(Node *)
+            {
+                return false;
+            }
+        };
+
+        // Height of the subtree rooted at every node, which makes depth() constant time.
+        struct height_augment
+        {
+            template <typename Node>
+            struct data
+            {
+                std::size_t height = 1;
+            };
+            template <typename Node>
+            static std::size_t height_of(Node const *p)
+            {
+                return p ? p->height : 0;
+            }
+            template <typename Node>
+            static bool update(Node *p)
+            {
+                auto height = std::max(height_of(p->left_child), height_of(p->right_child)) + 1;
+                return std::exchange(p->height, height) != height;
+            }
+        };
+
+        // Number of nodes in the subtree rooted at every node. It lets iterators find the k-th node of an order
+        // and the position of a node in O(depth), so they become random access.
+        struct size_augment
+        {
+            template <typename Node>
+            struct data
+            {
+                std::size_t size = 1;
+            };
+            template <typename Node>
+            static std::size_t size_of(Node const *p)
+            {
+                return p ? p->size : 0;
+            }
+            template <typename Node>
+            static bool update(Node *p)
+            {
+                auto size = size_of(p->left_child) + size_of(p->right_child) + 1;
+                return std::exchange(p->size, size) != size;
+            }
+        };
+
+        // In-order predecessor and successor of every node. They aren't derived from the children alone,
+        // so binary_tree relinks them itself whenever a child slot changes; inorder steps then never climb
+        // parent links.
+        struct inorder_threads
+        {
+            template <typename Node>
+            struct data
+            {
+                Node *inorder_previous = nullptr;
+                Node *inorder_next = nullptr;
+            };
+            template <typename Node>
+            static bool update(Node *)
+            {
+                return false;
+            }
+        };
+
+        // Hashes values for hash_augment. It has to agree with the values' operator==.
+        struct value_hash
+        {
+            template <typename T>
+            std::uint64_t operator()(T const &value) const
+            {
+                return std::hash<T>{}(value);
+            }
+        };
+        // Merkle hash of the subtree rooted at every node, covering the values and the shape. Trees whose root
+        // hashes differ can't be equal, and a tree whose hash is still the same as before most likely didn't change.
+        // Values changed in place have to be reported through binary_tree::value_changed.
+        // The data is the same whatever the hash function, so has_augment<Node, hash_augment<>> finds any of them.
+        struct subtree_hash
+        {
+            std::uint64_t hash = 0;
+        };
+        template <typename Hash = value_hash>
+        struct hash_augment
+        {
+            template <typename Node>
+            using data = subtree_hash;
+            template <typename Node>
+            static std::uint64_t hash_of(Node const *p)
+            {
+                return p ? p->hash : 0;
+            }
+            template <typename Node>
+            static bool update(Node *p)
+            {
+                auto hash = mix(mix(mix(Hash{}(p->value)) ^ hash_of(p->left_child)) ^ hash_of(p->right_child));
+                return std::exchange(p->hash, hash) != hash;
+            }
+            // Finalizer of splitmix64. Mixing again after every child keeps the left and right child apart.
+            static constexpr std::uint64_t mix(std::uint64_t h)
+            {
+                h += 0x9e3779b97f4a7c15;
+                h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9;
+                h = (h ^ (h >> 27)) * 0x94d049bb133111eb;
+                return h ^ (h >> 31);
+            }
+        };
+
+        // Several augmentations kept side by side. A node changed if any of them changed.
+        template <typename... Augments>
+        struct augments
+        {
+            template <typename Node>
+            struct data : Augments::template data<Node>...
+            {
+            };
+            template <typename Node>
+            static bool update(Node *p)
+            {
+                return (false | ... | Augments::update(p));
+            }
+        };
+
+        template <typename Node, typename augment>
+        constexpr bool has_augment = std::is_base_of_v<typename augment::template data<Node>, Node>;
+
+        struct defer_update_t
+        {
+            constexpr defer_update_t() = default;
+        };
+        constexpr defer_update_t defer_update;
+
+        template <typename T, typename Augment = no_augment>
+        struct node : Augment::template data<node<T, Augment>>
         {
             using value_type = T;
+            using augment_type = Augment;
 
             template <typename U>
-            explicit node(U &&value, node *parent, std::unique_ptr<node> left,
-                          std::unique_ptr<node> right)
-                :value(std::forward<U>(value)), left_child(std::move(left)), right_child(std::move(right)), parent(parent)
+            explicit node(U &&value, node *parent = nullptr, node *left = nullptr, node *right = nullptr)
+                :value(std::forward<U>(value)), left_child(left), right_child(right), parent(parent)
             {
             }
 
             value_type value;
-            std::unique_ptr<node> left_child;
-            std::unique_ptr<node> right_child;
+            node *left_child = nullptr;
+            node *right_child = nullptr;
             node *parent = nullptr;
         };
 
@@ -52,32 +207,42 @@ namespace ds_exp
         struct iterate_direction<left_first_t>
         {
             ~iterate_direction() = default;
-            template <typename T>
-            static auto &first_child(node<T> *p)
+            template <typename node_pointer>
+            static auto &first_child(node_pointer const &p)
             {
                 return p->left_child;
             }
-            template <typename T>
-            static auto &second_child(node<T> *p)
+            template <typename node_pointer>
+            static auto &second_child(node_pointer const &p)
             {
                 return p->right_child;
             }
+            template <typename node_pointer>
+            static auto &next_thread(node_pointer const &p)
+            {
+                return p->inorder_next;
+            }
         };
 
         template <>
         struct iterate_direction<right_first_t>
         {
             ~iterate_direction() = delete;
-            template <typename T>
-            static auto &first_child(node<T> *p)
+            template <typename node_pointer>
+            static auto &first_child(node_pointer const &p)
             {
                 return p->right_child;
             }
-            template <typename T>
-            static auto &second_child(node<T> *p)
+            template <typename node_pointer>
+            static auto &second_child(node_pointer const &p)
             {
                 return p->left_child;
             }
+            template <typename node_pointer>
+            static auto &next_thread(node_pointer const &p)
+            {
+                return p->inorder_previous;
+            }
         };
 
         struct inorder_t
@@ -96,55 +261,99 @@ namespace ds_exp
             constexpr preorder_t() = default;
             using inverse = postorder_t;
         };
+        // Level by level from the root, every level in the order of the direction. Iterators of this order hold only a
+        // node, so every step searches for the next node through the parent links and may have to look through whole
+        // subtrees that end above the level: a single step is O(n) in the worst case and a whole walk O(n * height).
+        // They suit positions and short walks; to visit a tree, use level_order(tree), whose steps are constant time.
+        struct reverse_levelorder_t;
+        struct levelorder_t
+        {
+            constexpr levelorder_t() = default;
+            using inverse = reverse_levelorder_t;
+        };
+        // Level order backwards, which is what stepping back through a level order walks.
+        struct reverse_levelorder_t
+        {
+            constexpr reverse_levelorder_t() = default;
+            using inverse = levelorder_t;
+        };
         constexpr inorder_t inorder;
         constexpr preorder_t preorder;
         constexpr postorder_t postorder;
+        constexpr levelorder_t levelorder;
 
-        template <typename T, typename order, typename dir>
+        template <typename node_type, typename order, typename dir>
         struct order_template;
-        template <typename T, typename dir>
-        struct order_template<T, inorder_t, dir>
+        template <typename Node, typename dir>
+        struct order_template<Node, inorder_t, dir>
         {
-            using node_type = node<T>;
+            using node_type = Node;
             using order_type = inorder_t;
             using direction = iterate_direction<dir>;
-            using inverse_order = order_template<T, order_type::inverse, typename dir::inverse>;
+            using inverse_order = order_template<Node, order_type::inverse, typename dir::inverse>;
             static node_type *begin(node_type *root)
             {
                 assert(root);
                 auto current = root;
                 while (direction::first_child(current))
-                    current = direction::first_child(current).get();
+                    current = direction::first_child(current);
                 return current;
             }
             static node_type *next(node_type *current)
             {
                 assert(current);
+                if constexpr (has_augment<node_type, inorder_threads>)
+                    return direction::next_thread(current);
                 if (direction::second_child(current))
-                    return begin(direction::second_child(current).get());
+                    return begin(direction::second_child(current));
                 else
                     return backtrack(current);
             }
             static node_type *backtrack(node_type *current)
             {
-                while (current->parent != nullptr && direction::second_child(current->parent).get() == current)
+                while (current->parent != nullptr && direction::second_child(current->parent) == current)
                     current = current->parent;
                 if (current->parent == nullptr)
                     return nullptr;
-                assert(direction::first_child(current->parent).get() == current);
+                assert(direction::first_child(current->parent) == current);
                 return current->parent;
             }
+            // Node at position k of the subtree, which must be smaller than its size. Needs size_augment.
+            static node_type *nth(node_type *current, std::size_t k)
+            {
+                while (true)
+                {
+                    auto first_size = size_augment::size_of(direction::first_child(current));
+                    if (k < first_size)
+                        current = direction::first_child(current);
+                    else if (k == first_size)
+                        return current;
+                    else
+                        k -= first_size + 1, current = direction::second_child(current);
+                }
+            }
+            // Position of current in the whole tree. Needs size_augment.
+            static std::size_t rank(node_type *current)
+            {
+                auto position = size_augment::size_of(direction::first_child(current));
+                for (; current->parent; current = current->parent)
+                {
+                    if (direction::second_child(current->parent) == current)
+                        position += size_augment::size_of(direction::first_child(current->parent)) + 1;
+                }
+                return position;
+            }
         };
 
-        template <typename T, typename dir>
-        struct order_template<T, postorder_t, dir>;
-        template <typename T, typename dir>
-        struct order_template<T, preorder_t, dir>
+        template <typename Node, typename dir>
+        struct order_template<Node, postorder_t, dir>;
+        template <typename Node, typename dir>
+        struct order_template<Node, preorder_t, dir>
         {
-            using node_type = node<T>;
+            using node_type = Node;
             using order_type = preorder_t;
             using direction = iterate_direction<dir>;
-            using inverse_order = order_template<T, order_type::inverse, typename dir::inverse>;
+            using inverse_order = order_template<Node, order_type::inverse, typename dir::inverse>;
             static node_type *begin(node_type *root)
             {
                 assert(root);
@@ -154,44 +363,68 @@ namespace ds_exp
             {
                 assert(current);
                 if (direction::first_child(current))
-                    return direction::first_child(current).get();
+                    return direction::first_child(current);
                 else if (direction::second_child(current))
-                    return direction::second_child(current).get();
+                    return direction::second_child(current);
                 else
                     return backtrack(current);
             }
             static node_type *backtrack(node_type *current)
             {
                 while (current->parent != nullptr &&
-                       (direction::second_child(current->parent).get() == current ||
+                       (direction::second_child(current->parent) == current ||
                         !direction::second_child(current->parent)))
                     current = current->parent;
                 if (current->parent == nullptr)
                     return nullptr;
-                assert(direction::first_child(current->parent).get() == current &&
+                assert(direction::first_child(current->parent) == current &&
                        direction::second_child(current->parent) != nullptr);
-                return direction::second_child(current->parent).get();
+                return direction::second_child(current->parent);
+            }
+            static node_type *nth(node_type *current, std::size_t k)
+            {
+                while (k != 0)
+                {
+                    auto first_size = size_augment::size_of(direction::first_child(current));
+                    --k;
+                    if (k < first_size)
+                        current = direction::first_child(current);
+                    else
+                        k -= first_size, current = direction::second_child(current);
+                }
+                return current;
+            }
+            static std::size_t rank(node_type *current)
+            {
+                std::size_t position = 0;
+                for (; current->parent; current = current->parent)
+                {
+                    if (direction::second_child(current->parent) == current)
+                        position += size_augment::size_of(direction::first_child(current->parent));
+                    ++position;
+                }
+                return position;
             }
         };
 
-        template <typename T, typename dir>
-        struct order_template<T, postorder_t, dir>
+        template <typename Node, typename dir>
+        struct order_template<Node, postorder_t, dir>
         {
-            using node_type = node<T>;
+            using node_type = Node;
             using order_type = postorder_t;
             using direction = iterate_direction<dir>;
-            using inverse_order = order_template<T, order_type::inverse, typename dir::inverse>;
+            using inverse_order = order_template<Node, order_type::inverse, typename dir::inverse>;
             static node_type *begin(node_type *root)
             {
                 assert(root);
                 auto current = root;
                 while (direction::first_child(current))
-                    current = direction::first_child(current).get();
+                    current = direction::first_child(current);
                 while (direction::second_child(current))
                 {
-                    current = direction::second_child(current).get();
+                    current = direction::second_child(current);
                     while (direction::first_child(current))
-                        current = direction::first_child(current).get();
+                        current = direction::first_child(current);
                 }
                 return current;
             }
@@ -200,280 +433,503 @@ namespace ds_exp
                 assert(current);
                 if (current->parent == nullptr)
                     return nullptr;
-                else if (direction::first_child(current->parent).get() == current &&
+                else if (direction::first_child(current->parent) == current &&
                          direction::second_child(current->parent) != nullptr)
-                    return begin(direction::second_child(current->parent).get());
+                    return begin(direction::second_child(current->parent));
                 else
                 {
-                    assert(direction::second_child(current->parent).get() == current ||
+                    assert(direction::second_child(current->parent) == current ||
                            direction::second_child(current->parent) == nullptr);
                     return current->parent;
                 }
             }
-        };
-
-        template <typename T>
-        class binary_tree
-        {
-            using default_order = preorder_t;
-            using default_direction = left_first_t;
-        public:
-            using value_type = T;
-            using node_type = node<value_type>;
-            using handler_type = std::unique_ptr<node_type>;
-            using size_type = std::size_t;
-
-        private:
-            struct base_iter
+            static node_type *nth(node_type *current, std::size_t k)
             {
-                using difference_type = std::ptrdiff_t;
-                using value_type = binary_tree::value_type;
-                using pointer = value_type *;
-                using reference = value_type &;
-                using iterator_category = std::bidirectional_iterator_tag;
-
-                template <typename iter1, typename iter2>
-                friend bool operator==(iter1 const &lhs, iter2 const &rhs)
+                while (true)
                 {
-                    return lhs.node == rhs.node;
-                }
-                template <typename iter1, typename iter2>
-                friend bool operator!=(iter1 const &lhs, iter2 const &rhs)
-                {
-                    return !(lhs == rhs);
+                    auto first_size = size_augment::size_of(direction::first_child(current));
+                    auto second_size = size_augment::size_of(direction::second_child(current));
+                    if (k < first_size)
+                        current = direction::first_child(current);
+                    else if (k < first_size + second_size)
+                        k -= first_size, current = direction::second_child(current);
+                    else
+                        return current;
                 }
-            };
-            explicit binary_tree(handler_type root)
-                : root_(std::move(root))
-            {
-                if (root_)
-                    root_->parent = nullptr;
             }
-        public:
-
-            template <typename, typename>
-            class iterator;
-
-            template <typename default_order, typename default_direction>
-            class const_iterator : public base_iter
+            static std::size_t rank(node_type *current)
             {
-                template <typename, typename>
-                friend
-                class iterator;
-                friend class binary_tree;
-
-                const_iterator(const binary_tree *tree, node_type *p)
-                    : tree(tree), node(p)
+                auto position = size_augment::size_of(current) - 1;
+                for (; current->parent; current = current->parent)
                 {
+                    if (direction::second_child(current->parent) == current)
+                        position += size_augment::size_of(direction::first_child(current->parent));
                 }
+                return position;
+            }
+        };
 
-                const binary_tree *tree;
-                node_type *node;
-            public:
-
-                template <typename order, typename direction>
-                const_iterator(const_iterator<order, direction> const &src)
-                    :tree(src.tree), node(src.node)
-                {
-                }
-                explicit operator bool() const
-                {
-                    return node != nullptr;
-                }
-                value_type const &operator*() const
-                {
-                    return node->value;
-                }
-                value_type const *operator->() const
-                {
-                    return &node->value;
-                }
-                auto &operator++()
-                {
-                    return next(), *this;
-                }
-                auto operator++(int)
-                {
-                    auto iter = *this;
-                    return this->next(), iter;
-                }
-                auto &operator--()
-                {
-                    return previous(), *this;
-                }
-                auto operator--(int)
-                {
-                    auto iter = *this;
-                    return this->previous(), iter;
-                }
-                template <typename order = default_order, typename direction = default_direction>
-                void next(order = order{}, direction = direction{})
-                {
-                    assert(node);
-                    node = order_template<value_type, order, direction>::next(node);
-                }
-                template <typename order = default_order, typename direction = default_direction>
-                void previous(order = order{}, direction = direction{})
+        // Finds nodes by their depth through the parent links, so level order needs no queue. A step may search all
+        // subtrees between two neighbours of a level, which is O(n) for one step when they end above it, and moving
+        // on to the next level starts again from the root, so a full walk is O(n * height) rather than O(n).
+        template <typename Node, typename dir>
+        struct level_walk
+        {
+            using node_type = Node;
+            using direction = iterate_direction<dir>;
+            // First node `distance` levels below top in the order of the direction, or nullptr if there is none.
+            static node_type *first_below(node_type *top, std::size_t distance)
+            {
+                node_type *current = top;
+                std::size_t level = 0;
+                while (level != distance)
                 {
-                    if (node == nullptr)
-                        node = order_template<value_type, order, direction>::inverse_order::begin(tree->root_.get());
+                    if (direction::first_child(current))
+                        current = direction::first_child(current), ++level;
+                    else if (direction::second_child(current))
+                        current = direction::second_child(current), ++level;
                     else
                     {
-                        auto pre = order_template<value_type, order, direction>::inverse_order::next(node);
-                        if (pre != nullptr)
-                            node = pre;
+                        while (true)
+                        {
+                            if (current == top)
+                                return nullptr;
+                            node_type *parent = current->parent;
+                            if (direction::first_child(parent) == current && direction::second_child(parent))
+                            {
+                                current = direction::second_child(parent);
+                                break;
+                            }
+                            current = parent, --level;
+                        }
                     }
                 }
-                template <typename direction = default_direction>
-                const_iterator first_child(direction = direction{}) const
-                {
-                    assert(node);
-                    return const_iterator(tree, iterate_direction<direction>::first_child(node).get());
-                }
-                template <typename direction = default_direction>
-                const_iterator second_child(direction = direction{}) const
-                {
-                    assert(node);
-                    return const_iterator(tree, iterate_direction<direction>::second_child(node).get());
-                }
-                const_iterator parent() const
-                {
-                    assert(node &&node->parent);
-                    return const_iterator(tree, node->parent);
-                }
-                template <typename order = default_order, typename direction = default_direction>
-                auto change(order = order{}, direction = direction{}) const
-                {
-                    return const_iterator<order, direction>(*this);
-                }
-                template <typename iter1, typename iter2>
-                friend bool operator==(iter1 const &, iter2 const &);
-            };
-
-            template <typename default_order, typename default_direction>
-            class iterator : public base_iter
+                return current;
+            }
+            // Next node on the level of current. If there is none, returns nullptr and sets root and the depth of current.
+            static node_type *next_in_level(node_type *current, node_type *&root, std::size_t &depth)
             {
-                friend class binary_tree;
-
-                iterator(binary_tree *tree, node_type *p)
-                    : tree(tree), node(p)
-                {
-                }
-
-                binary_tree *tree;
-                node_type *node;
-            public:
-                template <typename order = default_order, typename direction = default_direction>
-                iterator(iterator<order, direction> const &src)
-                    :tree(src.tree), node(src.node)
-                {
-                }
-                template <typename order, typename direction>
-                operator const_iterator<order, direction>()
-                {
-                    return const_iterator<order, direction>(tree, node);
-                }
-                explicit operator bool() const
-                {
-                    return node != nullptr;
-                }
-                value_type &operator*() const
-                {
-                    return node->value;
-                }
-                value_type *operator->() const
-                {
-                    return &node->value;
-                }
-                auto &operator++()
+                depth = 0;
+                for (; current->parent; ++depth)
                 {
-                    return next(), *this;
-                }
-                auto operator++(int)
-                {
-                    auto iter = *this;
-                    return this->next(), iter;
-                }
-                auto &operator--()
-                {
-                    return previous(), *this;
-                }
-                auto operator--(int)
-                {
-                    auto iter = *this;
-                    return this->previous(), iter;
-                }
-                template <typename order = default_order, typename direction = default_direction>
-                void next(order = order{}, direction = direction{})
-                {
-                    assert(node);
-                    node = order_template<value_type, order, direction>::next(node);
+                    node_type *parent = current->parent;
+                    if (direction::first_child(parent) == current && direction::second_child(parent))
+                    {
+                        if (auto found = first_below(direction::second_child(parent), depth))
+                            return found;
+                    }
+                    current = parent;
                 }
-                template <typename order = default_order, typename direction = default_direction>
-                void previous(order = order{}, direction = direction{})
+                root = current;
+                return nullptr;
+            }
+            static std::size_t height(node_type *root)
+            {
+                if constexpr (has_augment<node_type, height_augment>)
+                    return height_augment::height_of(root);
+                node_type *current = root;
+                std::size_t level = 1, height = 1;
+                while (true)
                 {
-                    if (node == nullptr)
-                        node = order_template<value_type, order, direction>::inverse_order::begin(tree->root_.get());
+                    if (direction::first_child(current))
+                        current = direction::first_child(current), height = std::max(height, ++level);
+                    else if (direction::second_child(current))
+                        current = direction::second_child(current), height = std::max(height, ++level);
                     else
                     {
-                        auto pre = order_template<value_type, order, direction>::inverse_order::next(node);
-                        if (pre != nullptr)
-                            node = pre;
+                        while (true)
+                        {
+                            if (current == root)
+                                return height;
+                            node_type *parent = current->parent;
+                            if (direction::first_child(parent) == current && direction::second_child(parent))
+                            {
+                                current = direction::second_child(parent);
+                                break;
+                            }
+                            current = parent, --level;
+                        }
                     }
                 }
-                template <typename direction = default_direction>
-                iterator first_child(direction = direction{}) const
-                {
-                    assert(node);
-                    return iterator(tree, iterate_direction<direction>::first_child(node).get());
-                }
-                template <typename direction = default_direction>
-                iterator second_child(direction = direction{}) const
-                {
-                    assert(node);
-                    return iterator(tree, iterate_direction<direction>::second_child(node).get());
-                }
-                iterator parent() const
-                {
-                    assert(node &&node->parent);
-                    return iterator(tree, node->parent);
-                }
-                template <typename order = default_order, typename direction = default_direction>
-                auto change(order = order{}, direction = direction{}) const
+            }
+        };
+        template <typename Node, typename dir>
+        struct order_template<Node, reverse_levelorder_t, dir>;
+        template <typename Node, typename dir>
+        struct order_template<Node, levelorder_t, dir>
+        {
+            using node_type = Node;
+            using order_type = levelorder_t;
+            using walk = level_walk<Node, dir>;
+            using inverse_order = order_template<Node, order_type::inverse, typename dir::inverse>;
+            static node_type *begin(node_type *root)
+            {
+                assert(root);
+                return root;
+            }
+            static node_type *next(node_type *current)
+            {
+                assert(current);
+                node_type *root = nullptr;
+                std::size_t depth = 0;
+                if (auto found = walk::next_in_level(current, root, depth))
+                    return found;
+                return walk::first_below(root, depth + 1);
+            }
+        };
+        template <typename Node, typename dir>
+        struct order_template<Node, reverse_levelorder_t, dir>
+        {
+            using node_type = Node;
+            using order_type = reverse_levelorder_t;
+            using walk = level_walk<Node, dir>;
+            using inverse_order = order_template<Node, order_type::inverse, typename dir::inverse>;
+            static node_type *begin(node_type *root)
+            {
+                assert(root);
+                return walk::first_below(root, walk::height(root) - 1);
+            }
+            static node_type *next(node_type *current)
+            {
+                assert(current);
+                node_type *root = nullptr;
+                std::size_t depth = 0;
+                if (auto found = walk::next_in_level(current, root, depth))
+                    return found;
+                return depth == 0 ? nullptr : walk::first_below(root, depth - 1);
+            }
+        };
+
+        template <typename Allocator, typename = void>
+        struct releases_in_bulk : std::false_type
+        {
+        };
+        template <typename Allocator>
+        struct releases_in_bulk<Allocator, std::void_t<typename Allocator::releases_in_bulk>> : Allocator::releases_in_bulk
+        {
+        };
+
+        template <typename Allocator, typename = void>
+        struct has_reserve : std::false_type
+        {
+        };
+        template <typename Allocator>
+        struct has_reserve<Allocator, std::void_t<decltype(std::declval<Allocator &>().reserve(std::size_t{}))>> : std::true_type
+        {
+        };
+
+        // Iterator shared by the tree containers. Tree provides value_type, node_type and root_node(),
+        // the walking itself is done by order_template of the node type.
+        template <typename Tree, typename default_order, typename default_direction, bool is_const>
+        class tree_iterator
+        {
+            template <typename, typename, typename, bool>
+            friend class tree_iterator;
+            friend Tree;
+
+            using tree_pointer = std::conditional_t<is_const, Tree const *, Tree *>;
+            using node_type = typename Tree::node_type;
+
+            tree_iterator(tree_pointer tree, node_type *p)
+                : tree(tree), node(p)
+            {
+            }
+
+            tree_pointer tree;
+            node_type *node;
+        public:
+            using difference_type = std::ptrdiff_t;
+            using value_type = typename Tree::value_type;
+            using pointer = std::conditional_t<is_const, value_type const *, value_type *>;
+            using reference = std::conditional_t<is_const, value_type const &, value_type &>;
+            // Positions in the level orders aren't kept track of by size_augment.
+            using iterator_category = std::conditional_t<has_augment<node_type, size_augment> &&
+                                                         !std::is_same_v<default_order, levelorder_t> &&
+                                                         !std::is_same_v<default_order, reverse_levelorder_t>,
+                                                         std::random_access_iterator_tag, std::bidirectional_iterator_tag>;
+
+            template <typename order, typename direction, bool src_const, std::enable_if_t<is_const || !src_const, int> = 0>
+            tree_iterator(tree_iterator<Tree, order, direction, src_const> const &src)
+                : tree(src.tree), node(src.node)
+            {
+            }
+            explicit operator bool() const
+            {
+                return node != nullptr;
+            }
+            reference operator*() const
+            {
+                return node->value;
+            }
+            pointer operator->() const
+            {
+                return &node->value;
+            }
+            auto &operator++()
+            {
+                return next(), *this;
+            }
+            auto operator++(int)
+            {
+                auto iter = *this;
+                return this->next(), iter;
+            }
+            auto &operator--()
+            {
+                return previous(), *this;
+            }
+            auto operator--(int)
+            {
+                auto iter = *this;
+                return this->previous(), iter;
+            }
+            // Random access needs size_augment. Every jump finds its target from the root in O(depth).
+            auto &operator+=(difference_type n)
+            {
+                auto target = static_cast<difference_type>(position()) + n;
+                auto size = static_cast<difference_type>(size_augment::size_of(tree->root_node()));
+                assert(0 <= target && target <= size);
+                node = target == size ? nullptr : walk::nth(tree->root_node(), static_cast<std::size_t>(target));
+                return *this;
+            }
+            auto &operator-=(difference_type n)
+            {
+                return *this += -n;
+            }
+            tree_iterator operator+(difference_type n) const
+            {
+                auto iter = *this;
+                return iter += n;
+            }
+            friend tree_iterator operator+(difference_type n, tree_iterator const &iter)
+            {
+                return iter + n;
+            }
+            tree_iterator operator-(difference_type n) const
+            {
+                auto iter = *this;
+                return iter -= n;
+            }
+            difference_type operator-(tree_iterator const &rhs) const
+            {
+                return static_cast<difference_type>(position()) - static_cast<difference_type>(rhs.position());
+            }
+            reference operator[](difference_type n) const
+            {
+                return *(*this + n);
+            }
+            bool operator<(tree_iterator const &rhs) const
+            {
+                return position() < rhs.position();
+            }
+            bool operator>(tree_iterator const &rhs) const
+            {
+                return rhs < *this;
+            }
+            bool operator<=(tree_iterator const &rhs) const
+            {
+                return !(rhs < *this);
+            }
+            bool operator>=(tree_iterator const &rhs) const
+            {
+                return !(*this < rhs);
+            }
+
+            template <typename order = default_order, typename direction = default_direction>
+            void next(order = order{}, direction = direction{})
+            {
+                assert(node);
+                node = order_template<node_type, order, direction>::next(node);
+            }
+            template <typename order = default_order, typename direction = default_direction>
+            void previous(order = order{}, direction = direction{})
+            {
+                if (node == nullptr)
+                    node = order_template<node_type, order, direction>::inverse_order::begin(tree->root_node());
+                else
                 {
-                    return iterator<order, direction>(*this);
+                    auto pre = order_template<node_type, order, direction>::inverse_order::next(node);
+                    if (pre != nullptr)
+                        node = pre;
                 }
+            }
+            template <typename direction = default_direction>
+            tree_iterator first_child(direction = direction{}) const
+            {
+                assert(node);
+                return tree_iterator(tree, iterate_direction<direction>::first_child(node));
+            }
+            template <typename direction = default_direction>
+            tree_iterator second_child(direction = direction{}) const
+            {
+                assert(node);
+                return tree_iterator(tree, iterate_direction<direction>::second_child(node));
+            }
+            tree_iterator parent() const
+            {
+                assert(node &&node->parent);
+                return tree_iterator(tree, node->parent);
+            }
+            template <typename order = default_order, typename direction = default_direction>
+            auto change(order = order{}, direction = direction{}) const
+            {
+                return tree_iterator<Tree, order, direction, is_const>(*this);
+            }
 
-                template <typename iter1, typename iter2>
-                friend bool operator==(iter1 const &, iter2 const &);
-            };
+            template <typename order, typename direction, bool rhs_const>
+            bool operator==(tree_iterator<Tree, order, direction, rhs_const> const &rhs) const
+            {
+                return node == rhs.node;
+            }
+            template <typename order, typename direction, bool rhs_const>
+            bool operator!=(tree_iterator<Tree, order, direction, rhs_const> const &rhs) const
+            {
+                return !(*this == rhs);
+            }
+
+        private:
+            using walk = order_template<node_type, default_order, default_direction>;
+            // Position in the order of the iterator, the end being one past the last node.
+            std::size_t position() const
+            {
+                static_assert(has_augment<node_type, size_augment>, "Random access iterators need size_augment.");
+                return node ? walk::rank(node) : size_augment::size_of(tree->root_node());
+            }
+        };
+
+        template <typename T, typename Allocator = std::allocator<T>, typename Augment = no_augment>
+        class binary_tree
+        {
+            using default_order = preorder_t;
+            using default_direction = left_first_t;
+        public:
+            using value_type = T;
+            using allocator_type = Allocator;
+            using augment_type = Augment;
+            using node_type = node<value_type, augment_type>;
+            using handler_type = node_type *;
+            using size_type = std::size_t;
+
+        private:
+            using node_allocator = typename std::allocator_traits<allocator_type>::template rebind_alloc<node_type>;
+            using node_traits = std::allocator_traits<node_allocator>;
+            static constexpr bool threaded = has_augment<node_type, inorder_threads>;
+            static constexpr bool sized = has_augment<node_type, size_augment>;
+            static constexpr bool hashed = has_augment<node_type, hash_augment<>>;
+
+            template <typename, typename, typename, bool>
+            friend class tree_iterator;
+
+            binary_tree(handler_type root, node_allocator const &alloc)
+                : alloc_(alloc), root_(root)
+            {
+                if (root_)
+                    root_->parent = nullptr;
+            }
+        public:
+            template <typename order_t, typename direction_t>
+            using iterator = tree_iterator<binary_tree, order_t, direction_t, false>;
+            template <typename order_t, typename direction_t>
+            using const_iterator = tree_iterator<binary_tree, order_t, direction_t, true>;
 
             binary_tree() = default;
-            binary_tree(binary_tree &&src) = default;
+            explicit binary_tree(allocator_type const &alloc)
+                : alloc_(alloc)
+            {
+            }
+            binary_tree(binary_tree &&src) noexcept
+                : alloc_(std::move(src.alloc_)), root_(std::exchange(src.root_, nullptr))
+            {
+            }
             binary_tree(binary_tree const &src)
+                : alloc_(node_traits::select_on_container_copy_construction(src.alloc_))
+            {
+                root_ = clone(src.root_);
+            }
+            // Copies a tree that uses another allocator or augmentation.
+            template <typename OtherAllocator, typename OtherAugment>
+            explicit binary_tree(binary_tree<value_type, OtherAllocator, OtherAugment> const &src, allocator_type const &alloc = allocator_type())
+                : alloc_(alloc)
             {
+                if (src.empty())
+                    return;
                 set_root(*src.root());
                 for (auto src_iter = src.begin(preorder), dest_iter = cbegin(preorder); src_iter != src.end(); ++src_iter, ++dest_iter)
                 {
                     if (src_iter.first_child())
-                        new_child(dest_iter, *src_iter.first_child(), default_direction{});
+                        new_child(dest_iter, *src_iter.first_child(), default_direction{}, defer_update);
                     if (src_iter.second_child())
-                        new_child(dest_iter, *src_iter.second_child(), default_direction::inverse{});
+                        new_child(dest_iter, *src_iter.second_child(), default_direction::inverse{}, defer_update);
+                }
+                update_augment();
+            }
+            ~binary_tree()
+            {
+                destroy(root_);
+            }
+
+            // Builds a height-balanced tree whose inorder sequence is [first, last), in O(n). Allocators that can
+            // reserve storage get room for all nodes up front.
+            template <typename ForwardIt>
+            static binary_tree from_sorted(ForwardIt first, ForwardIt last, allocator_type const &alloc = allocator_type())
+            {
+                binary_tree result(alloc);
+                auto n = static_cast<size_type>(std::distance(first, last));
+                if constexpr (has_reserve<node_allocator>::value)
+                    result.alloc_.reserve(n);
+                result.root_ = result.build_balanced(first, n, nullptr);
+                if constexpr (threaded)
+                    rethread(result.root_);
+                return result;
+            }
+            // Builds the tree with the given preorder and inorder sequences in O(n). The values have to be distinct;
+            // std::invalid_argument is thrown if no tree has both sequences.
+            template <typename InputIt1, typename InputIt2>
+            static binary_tree from_preorder_inorder(InputIt1 pre_first, InputIt1 pre_last, InputIt2 in_first, InputIt2 in_last,
+                                                     allocator_type const &alloc = allocator_type())
+            {
+                binary_tree result(alloc);
+                result.build_from_traversals<left_first_t>(pre_first, pre_last, in_first, in_last);
+                return result;
+            }
+            // Same for postorder and inorder. Reversed, they are the preorder and inorder of the right first
+            // direction, so both ranges are read backwards.
+            template <typename BidirIt1, typename BidirIt2>
+            static binary_tree from_postorder_inorder(BidirIt1 post_first, BidirIt1 post_last, BidirIt2 in_first, BidirIt2 in_last,
+                                                      allocator_type const &alloc = allocator_type())
+            {
+                binary_tree result(alloc);
+                result.build_from_traversals<right_first_t>(std::make_reverse_iterator(post_last), std::make_reverse_iterator(post_first),
+                                                            std::make_reverse_iterator(in_last), std::make_reverse_iterator(in_first));
+                return result;
+            }
+            binary_tree &operator=(binary_tree &&src) noexcept
+            {
+                if (this != &src)
+                {
+                    destroy(root_);
+                    alloc_ = std::move(src.alloc_);
+                    root_ = std::exchange(src.root_, nullptr);
                 }
+                return *this;
             }
-            binary_tree &operator=(binary_tree &&) = default;
             binary_tree &operator=(binary_tree const &src)
             {
                 *this = binary_tree(src);
                 return *this;
             }
 
+            allocator_type get_allocator() const
+            {
+                return allocator_type(alloc_);
+            }
+
             template <typename order_t = default_order, typename direction_t = default_direction>
             auto begin(order_t order = order_t{}, direction_t direction = direction_t{})
             {
                 if (!root_)
                     return end(order, direction);
-                return get_iter<order_t, direction_t>(order_template<value_type, order_t, direction_t>::begin(root_.get()));
+                return get_iter<order_t, direction_t>(order_template<node_type, order_t, direction_t>::begin(root_));
             }
 
             template <typename order_t = default_order, typename direction_t = default_direction>
@@ -481,7 +937,7 @@ namespace ds_exp
             {
                 if (!root_)
                     return end(order, direction);
-                return get_const_iter<order_t, direction_t>(order_template<value_type, order_t, direction_t>::begin(root_.get()));
+                return get_const_iter<order_t, direction_t>(order_template<node_type, order_t, direction_t>::begin(root_));
             }
             template <typename order_t = default_order, typename direction_t = default_direction>
             auto cbegin(order_t order = order_t{}, direction_t direction = direction_t{}) const
@@ -510,17 +966,19 @@ namespace ds_exp
             template <typename order_t = default_order, typename direction_t = default_direction>
             auto root(order_t = order_t{}, direction_t = direction_t{})
             {
-                return get_iter<order_t, direction_t>(root_.get());
+                return get_iter<order_t, direction_t>(root_);
             }
             template <typename order_t = default_order, typename direction_t = default_direction>
             auto root(order_t = order_t{}, direction_t = direction_t{}) const
             {
-                return get_const_iter<order_t, direction_t>(root_.get());
+                return get_const_iter<order_t, direction_t>(root_);
             }
 
             void clear()
             {
-                root_.reset();
+                destroy(std::exchange(root_, nullptr));
+                if constexpr (releases_in_bulk<node_allocator>::value)
+                    alloc_.release();
             }
             bool empty() const
             {
@@ -530,67 +988,271 @@ namespace ds_exp
             {
                 return subtree_depth(root());
             }
+            // Node behind iter. Unlike the iterator it doesn't refer to the tree object, so it stays valid when
+            // the tree is moved or the node is spliced into another tree.
+            template <typename order_t, typename direction_t, bool is_const>
+            static handler_type handler_of(tree_iterator<binary_tree, order_t, direction_t, is_const> const &iter)
+            {
+                return iter.node;
+            }
+            template <typename order_t = default_order, typename direction_t = default_direction>
+            auto iterator_to(handler_type node, order_t = order_t{}, direction_t = direction_t{})
+            {
+                return get_iter<order_t, direction_t>(node);
+            }
+            template <typename order_t = default_order, typename direction_t = default_direction>
+            auto iterator_to(handler_type node, order_t = order_t{}, direction_t = direction_t{}) const
+            {
+                return get_const_iter<order_t, direction_t>(node);
+            }
+            // Constant time with size_augment, a full walk otherwise.
+            size_type size() const
+            {
+                if constexpr (sized)
+                    return size_augment::size_of(root_);
+                return static_cast<size_type>(std::distance(begin(), end()));
+            }
+            // Iterator to position k of the order, or the end if k isn't smaller than size(). Needs size_augment.
+            template <typename order_t = default_order, typename direction_t = default_direction>
+            auto nth(size_type k, order_t = order_t{}, direction_t = direction_t{})
+            {
+                static_assert(sized, "nth needs size_augment.");
+                return get_iter<order_t, direction_t>(k < size() ? order_template<node_type, order_t, direction_t>::nth(root_, k) : nullptr);
+            }
+            template <typename order_t = default_order, typename direction_t = default_direction>
+            auto nth(size_type k, order_t = order_t{}, direction_t = direction_t{}) const
+            {
+                static_assert(sized, "nth needs size_augment.");
+                return get_const_iter<order_t, direction_t>(k < size() ? order_template<node_type, order_t, direction_t>::nth(root_, k) : nullptr);
+            }
+            // Position of iter in its own order, size() for the end. Needs size_augment.
+            template <typename order_t, typename direction_t, bool is_const>
+            size_type rank(tree_iterator<binary_tree, order_t, direction_t, is_const> const &iter) const
+            {
+                static_assert(sized, "rank needs size_augment.");
+                return iter.node ? order_template<node_type, order_t, direction_t>::rank(iter.node) : size();
+            }
+            // Walks the subtree in preorder through the parent links, so the cost doesn't include a call frame per level.
+            // With height_augment the height cached in the node is returned instead.
             template <typename iter>
             std::size_t subtree_depth(iter subtree_root) const
             {
+                if constexpr (has_augment<node_type, height_augment>)
+                    return height_augment::height_of(subtree_root.node);
                 if (subtree_root == end())
                     return 0;
-                auto i = std::max(subtree_depth(subtree_root.first_child()), subtree_depth(subtree_root.second_child())) + 1;
-                return i;
+                auto top = subtree_root.node, current = top;
+                std::size_t depth = 1, max_depth = 1;
+                while (true)
+                {
+                    if (current->left_child)
+                        current = current->left_child;
+                    else if (current->right_child)
+                        current = current->right_child;
+                    else
+                    {
+                        while (current != top && (current->parent->right_child == current || !current->parent->right_child))
+                            current = current->parent, --depth;
+                        if (current == top)
+                            return max_depth;
+                        current = current->parent->right_child;
+                        continue;
+                    }
+                    max_depth = std::max(max_depth, ++depth);
+                }
             }
 
             template <typename iter>
             binary_tree replace(iter replaced, binary_tree &&new_tree)
             {
+                // Nodes of another allocator couldn't be given back through ours, so they are copied.
+                if (alloc_ != new_tree.alloc_)
+                    new_tree = binary_tree(new_tree, get_allocator());
                 handler_type *handler = nullptr;
                 if (replaced == root())
                     handler = &root_;
                 else
                     handler = &get_handler(replaced.node);
                 auto parent = (*handler)->parent;
-                auto returned = std::move(*handler);
-                *handler = std::move(new_tree.root_);
+                auto returned = *handler;
+                splice_threads(parent, *handler, new_tree.root_);
+                *handler = std::exchange(new_tree.root_, nullptr);
                 if (*handler)
                     (*handler)->parent = parent;
-                return binary_tree(returned);
+                fix_upward(parent);
+                return binary_tree(returned, alloc_);
             }
 
             template <typename iter>
             binary_tree remove(iter subtree)
             {
-                return replace(subtree, binary_tree{});
+                return replace(subtree, binary_tree(get_allocator()));
             }
 
             template <typename U>
             void set_root(U &&u)
             {
-                root_ = make_handler(std::forward<U>(u), nullptr);
+                auto old_root = std::exchange(root_, make_handler(std::forward<U>(u), nullptr));
+                destroy(old_root);
             }
             template <typename direction, typename iter, typename U>
             iter new_child(iter parent, U &&u, direction = direction{})
+            {
+                [[maybe_unused]] auto neighbours = thread_neighbours(parent.node, iterate_direction<direction>::first_child(parent.node));
+                auto child = new_child(parent, std::forward<U>(u), direction{}, defer_update);
+                if constexpr (threaded)
+                    thread_between(neighbours.first, child.node, neighbours.second);
+                fix_upward(parent.node);
+                return child;
+            }
+            // Links the new child without fixing up the augmentation of its ancestors. Builders adding many
+            // nodes this way call update_augment() once they are done.
+            template <typename direction, typename iter, typename U>
+            iter new_child(iter parent, U &&u, direction, defer_update_t)
             {
                 auto &child = iterate_direction<direction>::first_child(parent.node);
-                child = make_handler(std::forward<U>(u), parent.node);
-                return iter(this, child.get());
+                auto old_child = std::exchange(child, make_handler(std::forward<U>(u), parent.node));
+                destroy(old_child);
+                return iter(this, child);
             }
             template <typename iter, typename direction_t>
             binary_tree replace_child(iter parent, binary_tree &&tree, direction_t = direction_t{})
             {
+                if (alloc_ != tree.alloc_)
+                    tree = binary_tree(tree, get_allocator());
                 auto &child = iterate_direction<direction_t>::first_child(parent.node);
-                auto replaced = std::move(child);
-                child = std::move(tree.root_);
+                splice_threads(parent.node, child, tree.root_);
+                auto replaced = std::exchange(child, std::exchange(tree.root_, nullptr));
                 if (child)
                     child->parent = parent.node;
-                return binary_tree(std::move(replaced));
+                fix_upward(parent.node);
+                return binary_tree(replaced, alloc_);
+            }
+            // Turns the node at pos into the parent of its parent, keeping the in-order sequence. Balancing
+            // policies build on it. Returns pos.
+            template <typename iter>
+            iter rotate(iter pos)
+            {
+                auto p = pos.node, parent = p->parent;
+                assert(parent);
+                auto &slot = parent->parent ? get_handler(parent) : root_;
+                if (parent->left_child == p)
+                {
+                    parent->left_child = p->right_child;
+                    if (p->right_child)
+                        p->right_child->parent = parent;
+                    p->right_child = parent;
+                }
+                else
+                {
+                    parent->right_child = p->left_child;
+                    if (p->left_child)
+                        p->left_child->parent = parent;
+                    p->left_child = parent;
+                }
+                p->parent = parent->parent;
+                parent->parent = p;
+                slot = p;
+                augment_type::update(parent);
+                augment_type::update(p);
+                fix_upward(p->parent);
+                return pos;
+            }
+            // Removes the node at pos alone. A node with two children is replaced by its in-order successor,
+            // which is relinked rather than copied, so iterators to all other nodes stay valid. Returns the lowest
+            // node whose subtree changed, or the end when the tree is empty now.
+            template <typename iter>
+            iter erase(iter pos)
+            {
+                auto p = pos.node;
+                auto &slot = p->parent ? get_handler(p) : root_;
+                if constexpr (threaded)
+                {
+                    if (p->inorder_previous)
+                        p->inorder_previous->inorder_next = p->inorder_next;
+                    if (p->inorder_next)
+                        p->inorder_next->inorder_previous = p->inorder_previous;
+                }
+                node_type *changed;
+                if (p->left_child && p->right_child)
+                {
+                    auto successor = leftmost(p->right_child);
+                    changed = successor;
+                    if (successor != p->right_child)
+                    {
+                        changed = successor->parent;
+                        changed->left_child = successor->right_child;
+                        if (successor->right_child)
+                            successor->right_child->parent = changed;
+                        successor->right_child = p->right_child;
+                        p->right_child->parent = successor;
+                    }
+                    successor->left_child = p->left_child;
+                    p->left_child->parent = successor;
+                    successor->parent = p->parent;
+                    slot = successor;
+                    // The successor took over data of p, so the path down to its old place is updated unconditionally.
+                    for (auto q = changed; q != successor; q = q->parent)
+                        augment_type::update(q);
+                    augment_type::update(successor);
+                    fix_upward(successor->parent);
+                }
+                else
+                {
+                    auto child = p->left_child ? p->left_child : p->right_child;
+                    slot = child;
+                    if (child)
+                        child->parent = p->parent;
+                    changed = p->parent;
+                    fix_upward(changed);
+                }
+                destroy_node(p);
+                return iter(this, changed);
+            }
+            // Recomputes the augmentation of every node in one postorder walk.
+            void update_augment()
+            {
+                update_subtree(root_);
+                if constexpr (threaded)
+                    rethread(root_);
+            }
+
+            // Recomputes the augmentation depending on the value at pos after it was changed in place.
+            template <typename iter>
+            void value_changed(iter pos)
+            {
+                fix_upward(pos.node);
+            }
+            // Merkle hash of the whole tree, 0 for an empty one. Needs hash_augment.
+            std::uint64_t hash() const
+            {
+                static_assert(hashed, "hash needs hash_augment.");
+                return hash_augment<>::hash_of(root_);
+            }
+            // Whether the tree changed since hash() returned old_hash. A change is missed only on a hash collision.
+            bool changed_since(std::uint64_t old_hash) const
+            {
+                return hash() != old_hash;
             }
 
+            // Trees are equal if they have the same shape and equal values. With hash_augment unequal trees are
+            // mostly told apart by their root hashes alone.
             friend bool operator==(binary_tree const &lhs, binary_tree const &rhs)
             {
+                if (&lhs == &rhs)
+                    return true;
+                if constexpr (hashed)
+                {
+                    if (lhs.hash() != rhs.hash())
+                        return false;
+                }
                 auto left_iter = lhs.begin(preorder), right_iter = rhs.begin(preorder);
                 for (; left_iter != lhs.end() && right_iter != rhs.end(); ++left_iter, ++right_iter)
                 {
                     if (*left_iter != *right_iter)
                         return false;
+                    if (!left_iter.first_child() != !right_iter.first_child() || !left_iter.second_child() != !right_iter.second_child())
+                        return false;
                 }
                 return left_iter == right_iter;
             }
@@ -606,9 +1268,13 @@ namespace ds_exp
             {
                 return const_iterator<default_order, default_direction>{this, p};
             }
+            node_type *root_node() const
+            {
+                return root_;
+            }
             auto &get_handler(node_type *p)
             {
-                if (p->parent->left_child.get() == p)
+                if (p->parent->left_child == p)
                     return p->parent->left_child;
                 else
                     return p->parent->right_child;
@@ -616,9 +1282,341 @@ namespace ds_exp
             template <typename U>
             auto make_handler(U &&u, node_type *parent = nullptr, handler_type left = nullptr, handler_type right = nullptr)
             {
-                return std::make_unique<node_type>(std::forward<U>(u), parent, std::move(left), std::move(right));
+                auto p = node_traits::allocate(alloc_, 1);
+                try
+                {
+                    node_traits::construct(alloc_, p, std::forward<U>(u), parent, left, right);
+                }
+                catch (...)
+                {
+                    node_traits::deallocate(alloc_, p, 1);
+                    throw;
+                }
+                augment_type::update(p);
+                return p;
+            }
+            void fix_upward(node_type *p)
+            {
+                while (p && augment_type::update(p))
+                    p = p->parent;
+            }
+            void destroy_node(node_type *p)
+            {
+                node_traits::destroy(alloc_, p);
+                node_traits::deallocate(alloc_, p, 1);
+            }
+            void update_subtree(node_type *subtree)
+            {
+                if constexpr (std::is_same_v<augment_type, no_augment>)
+                    return;
+                if (!subtree)
+                    return;
+                using postorder_walk = order_template<node_type, postorder_t, left_first_t>;
+                for (auto current = postorder_walk::begin(subtree); current != subtree; current = postorder_walk::next(current))
+                    augment_type::update(current);
+                augment_type::update(subtree);
+            }
+
+            static node_type *leftmost(node_type *p)
+            {
+                while (p->left_child)
+                    p = p->left_child;
+                return p;
+            }
+            static node_type *rightmost(node_type *p)
+            {
+                while (p->right_child)
+                    p = p->right_child;
+                return p;
+            }
+            // In-order neighbours of a child slot of parent, or of the root slot when parent is null.
+            static std::pair<node_type *, node_type *> thread_neighbours(node_type *parent, node_type *const &slot)
+            {
+                if constexpr (threaded)
+                {
+                    if (slot)
+                        return {leftmost(slot)->inorder_previous, rightmost(slot)->inorder_next};
+                    if (!parent)
+                        return {nullptr, nullptr};
+                    if (&slot == &parent->left_child)
+                        return {parent->inorder_previous, parent};
+                    return {parent, parent->inorder_next};
+                }
+                return {nullptr, nullptr};
+            }
+            // Threads subtree between before and after, or links those two directly when subtree is empty.
+            static void thread_between(node_type *before, node_type *subtree, node_type *after)
+            {
+                auto first = subtree ? leftmost(subtree) : after;
+                auto last = subtree ? rightmost(subtree) : before;
+                if (before)
+                    before->inorder_next = first;
+                if (first)
+                    first->inorder_previous = before;
+                if (after)
+                    after->inorder_previous = last;
+                if (last)
+                    last->inorder_next = after;
+            }
+            // Rethreads for replacing the subtree in slot by new_subtree, which leaves the old subtree threaded on its own.
+            static void splice_threads(node_type *parent, node_type *const &slot, node_type *new_subtree)
+            {
+                if constexpr (threaded)
+                {
+                    auto [before, after] = thread_neighbours(parent, slot);
+                    if (slot)
+                        thread_between(nullptr, slot, nullptr);
+                    thread_between(before, new_subtree, after);
+                }
+            }
+            // Threads a whole tree from scratch along an in-order walk over the parent links.
+            static void rethread(node_type *root)
+            {
+                node_type *previous = nullptr;
+                auto current = root ? leftmost(root) : nullptr;
+                while (current)
+                {
+                    current->inorder_previous = previous;
+                    if (previous)
+                        previous->inorder_next = current;
+                    previous = current;
+                    if (current->right_child)
+                        current = leftmost(current->right_child);
+                    else
+                    {
+                        while (current->parent && current->parent->right_child == current)
+                            current = current->parent;
+                        current = current->parent;
+                    }
+                }
+                if (previous)
+                    previous->inorder_next = nullptr;
+            }
+
+            // Large trees are copied and freed by splitting them into a top part of at most parallel_split_nodes
+            // nodes, visited breadth first, and the disjoint subtrees hanging below it, which are handled on the
+            // shared thread_pool. Only stateless allocators are used from several threads at once. Smaller trees
+            // never touch the pool, so it is not started by programs that only use small trees. Trees destroyed
+            // after the pool itself, such as statics, are freed on the calling thread.
+            static constexpr std::size_t parallel_split_nodes = 4096;
+            static thread_pool *parallel_pool(node_type const *subtree)
+            {
+                if (!node_traits::is_always_equal::value || !larger_than(subtree, parallel_split_nodes))
+                    return nullptr;
+                auto pool = thread_pool::shared_if_alive();
+                return pool && pool->concurrency() > 1 ? pool : nullptr;
+            }
+            // Counts at most bound + 1 nodes of the subtree without allocating.
+            static bool larger_than(node_type const *subtree, std::size_t bound)
+            {
+                if constexpr (has_augment<node_type, size_augment>)
+                    return size_augment::size_of(subtree) > bound;
+                std::size_t count = 0;
+                for (auto current = subtree; current;)
+                {
+                    if (++count > bound)
+                        return true;
+                    if (current->left_child || current->right_child)
+                    {
+                        current = current->left_child ? current->left_child : current->right_child;
+                        continue;
+                    }
+                    while (current != subtree &&
+                           (current == current->parent->right_child || !current->parent->right_child))
+                        current = current->parent;
+                    current = current == subtree ? nullptr : current->parent->right_child;
+                }
+                return false;
+            }
+
+            node_type *clone(node_type const *src_root)
+            {
+                if (!src_root)
+                    return nullptr;
+                auto pool = parallel_pool(src_root);
+                if (!pool)
+                {
+                    auto root = clone_subtree(src_root, nullptr);
+                    if constexpr (threaded)
+                        rethread(root);
+                    return root;
+                }
+                binary_tree result(make_handler(src_root->value), alloc_);
+                std::vector<std::pair<node_type const *, node_type *>> top{{src_root, result.root_}};
+                std::vector<std::tuple<node_type const *, node_type *, bool>> below;
+                for (std::size_t i = 0; i < top.size(); ++i)
+                {
+                    auto [src, dest] = top[i];
+                    for (auto left : {true, false})
+                    {
+                        auto child = left ? src->left_child : src->right_child;
+                        if (!child)
+                            continue;
+                        if (top.size() + below.size() >= parallel_split_nodes)
+                            below.emplace_back(child, dest, left);
+                        else
+                        {
+                            auto &slot = left ? dest->left_child : dest->right_child;
+                            slot = make_handler(child->value, dest);
+                            top.emplace_back(child, slot);
+                        }
+                    }
+                }
+                pool->for_each_index(below.size(), [&](std::size_t i) {
+                    auto [src, parent, left] = below[i];
+                    (left ? parent->left_child : parent->right_child) = clone_subtree(src, parent);
+                });
+                for (auto i = top.size(); i-- > 0;)
+                    augment_type::update(top[i].second);
+                if constexpr (threaded)
+                    rethread(result.root_);
+                return std::exchange(result.root_, nullptr);
+            }
+            // Takes the next n values from first. The left half goes below the middle value, so the recursion is only
+            // O(log n) deep.
+            template <typename ForwardIt>
+            node_type *build_balanced(ForwardIt &first, size_type n, node_type *parent)
+            {
+                if (n == 0)
+                    return nullptr;
+                auto left = build_balanced(first, n / 2, nullptr);
+                node_type *p = nullptr;
+                try
+                {
+                    p = make_handler(*first, parent, left);
+                }
+                catch (...)
+                {
+                    destroy(left);
+                    throw;
+                }
+                ++first;
+                if (left)
+                    left->parent = p;
+                try
+                {
+                    p->right_child = build_balanced(first, n - n / 2 - 1, p);
+                }
+                catch (...)
+                {
+                    destroy(p);
+                    throw;
+                }
+                augment_type::update(p);
+                return p;
+            }
+            // Builds from the preorder and inorder of direction with a stack of the nodes whose first subtree is
+            // still being built. A node is popped once the inorder reaches it, and the next preorder value becomes
+            // the second child of the last popped node, or else the first child of the top of the stack.
+            template <typename direction, typename InputIt1, typename InputIt2>
+            void build_from_traversals(InputIt1 pre_first, InputIt1 pre_last, InputIt2 in_first, InputIt2 in_last)
+            {
+                auto invalid = [] { throw std::invalid_argument("The traversal sequences don't belong to one tree."); };
+                if (pre_first == pre_last)
+                {
+                    if (in_first != in_last)
+                        invalid();
+                    return;
+                }
+                set_root(*pre_first);
+                std::vector<node_type *> pending{root_};
+                auto pop_visited = [&] {
+                    node_type *popped = nullptr;
+                    while (!pending.empty() && in_first != in_last && pending.back()->value == *in_first)
+                        popped = pending.back(), pending.pop_back(), ++in_first;
+                    return popped;
+                };
+                for (++pre_first; pre_first != pre_last; ++pre_first)
+                {
+                    auto parent = pop_visited();
+                    auto &slot = parent ? iterate_direction<direction>::second_child(parent) : iterate_direction<direction>::first_child(pending.back());
+                    slot = make_handler(*pre_first, parent ? parent : pending.back());
+                    pending.push_back(slot);
+                }
+                pop_visited();
+                if (!pending.empty() || in_first != in_last)
+                    invalid();
+                update_augment();
+            }
+            // Copies the subtree along a preorder walk of the source, mirroring every move in the copy.
+            node_type *clone_subtree(node_type const *src_root, node_type *parent)
+            {
+                auto dest_root = make_handler(src_root->value, parent);
+                try
+                {
+                    auto src = src_root;
+                    auto dest = dest_root;
+                    while (true)
+                    {
+                        if (src->left_child)
+                        {
+                            src = src->left_child;
+                            dest = dest->left_child = make_handler(src->value, dest);
+                            continue;
+                        }
+                        if (src->right_child)
+                        {
+                            src = src->right_child;
+                            dest = dest->right_child = make_handler(src->value, dest);
+                            continue;
+                        }
+                        while (src != src_root && (src->parent->right_child == src || !src->parent->right_child))
+                            src = src->parent, dest = dest->parent;
+                        if (src == src_root)
+                            break;
+                        src = src->parent->right_child;
+                        dest = dest->parent->right_child = make_handler(src->value, dest->parent);
+                    }
+                }
+                catch (...)
+                {
+                    destroy_subtree(dest_root);
+                    throw;
+                }
+                update_subtree(dest_root);
+                return dest_root;
+            }
+
+            // Frees a detached subtree. Allocators that release their storage in bulk only need to visit
+            // the nodes when values have destructors to run.
+            void destroy(node_type *subtree)
+            {
+                if constexpr (releases_in_bulk<node_allocator>::value && std::is_trivially_destructible_v<node_type>)
+                    return;
+                if (!subtree)
+                    return;
+                if (auto pool = parallel_pool(subtree))
+                {
+                    std::vector<node_type *> top{subtree}, below;
+                    for (std::size_t i = 0; i < top.size(); ++i)
+                        for (auto child : {top[i]->left_child, top[i]->right_child})
+                            if (child)
+                                (top.size() + below.size() >= parallel_split_nodes ? below : top).push_back(child);
+                    if (!below.empty())
+                    {
+                        pool->for_each_index(below.size(), [&](std::size_t i) { destroy_subtree(below[i]); });
+                        for (auto p : top)
+                            destroy_node(p);
+                        return;
+                    }
+                }
+                destroy_subtree(subtree);
+            }
+            // Frees the nodes along a postorder walk so that no call frame is needed per level.
+            void destroy_subtree(node_type *subtree)
+            {
+                using postorder_walk = order_template<node_type, postorder_t, left_first_t>;
+                auto current = postorder_walk::begin(subtree);
+                while (current != subtree)
+                {
+                    auto next = postorder_walk::next(current);
+                    destroy_node(current);
+                    current = next;
+                }
+                destroy_node(subtree);
             }
-            handler_type root_;
+            node_allocator alloc_;
+            handler_type root_ = nullptr;
         };
 
         template <typename tree_t, typename order_t, typename dir_t>
@@ -653,6 +1651,206 @@ namespace ds_exp
         {
             return iterate_adapter<tree_t, order_t, dir_t>(std::forward<tree_t>(tree));
         }
+
+        // Queue of pointers in a power-of-two sized array that doubles when it is full. Clearing it keeps the
+        // storage, so reusing it allocates nothing once it has grown to the largest size needed.
+        template <typename T>
+        class pointer_ring
+        {
+        public:
+            bool empty() const
+            {
+                return count == 0;
+            }
+            T front() const
+            {
+                return slots[head];
+            }
+            void push_back(T p)
+            {
+                if (count == slots.size())
+                    grow();
+                slots[(head + count++) & (slots.size() - 1)] = p;
+            }
+            void pop_front()
+            {
+                head = (head + 1) & (slots.size() - 1);
+                --count;
+            }
+            void clear()
+            {
+                head = count = 0;
+            }
+
+        private:
+            void grow()
+            {
+                std::vector<T> larger(std::max<std::size_t>(slots.size() * 2, 64));
+                for (std::size_t i = 0; i < count; ++i)
+                    larger[i] = slots[(head + i) & (slots.size() - 1)];
+                slots.swap(larger);
+                head = 0;
+            }
+
+            std::vector<T> slots;
+            std::size_t head = 0;
+            std::size_t count = 0;
+        };
+
+        // Level order of a binary_tree through a queue of node pointers. Its steps are constant time, unlike those of
+        // levelorder_t iterators, at the cost of memory for the widest level. Iterating the range again reuses the
+        // queue. Its iterators are input iterators.
+        template <typename Tree, typename dir_t = left_first_t>
+        class level_order_range
+        {
+            using tree_type = std::remove_const_t<Tree>;
+            using handler_type = typename tree_type::handler_type;
+            using direction = iterate_direction<dir_t>;
+        public:
+            class iterator
+            {
+                friend class level_order_range;
+
+                explicit iterator(level_order_range *range)
+                    : range(range)
+                {
+                }
+            public:
+                using difference_type = std::ptrdiff_t;
+                using value_type = typename tree_type::value_type;
+                using pointer = std::conditional_t<std::is_const_v<Tree>, value_type const *, value_type *>;
+                using reference = std::conditional_t<std::is_const_v<Tree>, value_type const &, value_type &>;
+                using iterator_category = std::input_iterator_tag;
+
+                iterator() = default;
+                reference operator*() const
+                {
+                    return range->queue.front()->value;
+                }
+                pointer operator->() const
+                {
+                    return &range->queue.front()->value;
+                }
+                iterator &operator++()
+                {
+                    range->advance();
+                    return *this;
+                }
+                void operator++(int)
+                {
+                    range->advance();
+                }
+                bool operator==(iterator const &rhs) const
+                {
+                    return at_end() == rhs.at_end();
+                }
+                bool operator!=(iterator const &rhs) const
+                {
+                    return !(*this == rhs);
+                }
+
+            private:
+                bool at_end() const
+                {
+                    return !range || range->queue.empty();
+                }
+
+                level_order_range *range = nullptr;
+            };
+
+            explicit level_order_range(Tree &tree)
+                : tree(tree)
+            {
+            }
+            level_order_range(level_order_range const &) = delete;
+            level_order_range &operator=(level_order_range const &) = delete;
+
+            iterator begin()
+            {
+                queue.clear();
+                if (auto root = tree_type::handler_of(tree.root()))
+                    queue.push_back(root);
+                return iterator(this);
+            }
+            iterator end()
+            {
+                return iterator();
+            }
+
+        private:
+            void advance()
+            {
+                auto p = queue.front();
+                queue.pop_front();
+                if (direction::first_child(p))
+                    queue.push_back(direction::first_child(p));
+                if (direction::second_child(p))
+                    queue.push_back(direction::second_child(p));
+            }
+
+            Tree &tree;
+            pointer_ring<handler_type> queue;
+        };
+        template <typename Tree, typename dir_t = left_first_t>
+        level_order_range<Tree, dir_t> level_order(Tree &tree, dir_t = dir_t{})
+        {
+            return level_order_range<Tree, dir_t>(tree);
+        }
+
+        // Morris traversal: calls callable on every element in inorder or preorder without a stack and without
+        // following parent links. It threads empty child links back to the nodes still to be visited while it runs,
+        // and restores every one of them before it returns, also when callable throws. Meanwhile the shape of the
+        // tree must not be looked at, so callable may only use the element it gets.
+        template <typename T, typename Allocator, typename Augment, typename Callable, typename order_t, typename dir_t = left_first_t>
+        void morris_for_each(binary_tree<T, Allocator, Augment> &tree, Callable callable, order_t, dir_t = dir_t{})
+        {
+            static_assert(std::is_same_v<order_t, inorder_t> || std::is_same_v<order_t, preorder_t>,
+                          "Morris traversal walks inorder or preorder.");
+            using direction = iterate_direction<dir_t>;
+            std::exception_ptr error;
+            auto visit = [&](auto *p) {
+                if (error)
+                    return;
+                try
+                {
+                    callable(p->value);
+                }
+                catch (...)
+                {
+                    error = std::current_exception();
+                }
+            };
+            auto current = binary_tree<T, Allocator, Augment>::handler_of(tree.root());
+            while (current)
+            {
+                if (!direction::first_child(current))
+                {
+                    visit(current);
+                    current = direction::second_child(current);
+                    continue;
+                }
+                // The last node before current, which is where the walk has to come back from.
+                auto last = direction::first_child(current);
+                while (direction::second_child(last) && direction::second_child(last) != current)
+                    last = direction::second_child(last);
+                if (!direction::second_child(last))
+                {
+                    if constexpr (std::is_same_v<order_t, preorder_t>)
+                        visit(current);
+                    direction::second_child(last) = current;
+                    current = direction::first_child(current);
+                }
+                else
+                {
+                    direction::second_child(last) = nullptr;
+                    if constexpr (std::is_same_v<order_t, inorder_t>)
+                        visit(current);
+                    current = direction::second_child(current);
+                }
+            }
+            if (error)
+                std::rethrow_exception(error);
+        }
     }
 }
 
@@ -0,0 +1,306 @@
+#ifndef INC_201703_COMPACT_TREE_HPP
+#define INC_201703_COMPACT_TREE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+#include "binary_tree.hpp"
+
+namespace ds_exp
+{
+    inline namespace tree
+    {
+        // Link stored as a 32-bit byte offset from the link itself, 0 meaning null.
+        // Links can't be copied like pointers: copy_offset keeps the offset, so a block of nodes stays
+        // linked when it is copied or moved as a whole, the way std::vector relocates its elements.
+        template <typename Node>
+        class relative_link
+        {
+        public:
+            relative_link() = default;
+            relative_link(relative_link const &) = delete;
+            relative_link &operator=(relative_link const &) = delete;
+
+            relative_link &operator=(Node *target)
+            {
+                offset = target ? static_cast<std::int32_t>(address(target) - address(this)) : 0;
+                return *this;
+            }
+            relative_link &copy_offset(relative_link const &src)
+            {
+                offset = src.offset;
+                return *this;
+            }
+            operator Node *() const
+            {
+                return offset ? reinterpret_cast<Node *>(address(this) + offset) : nullptr;
+            }
+            Node *operator->() const
+            {
+                return *this;
+            }
+            // Compared as the pointers they stand for. Exact overloads, so that generic comparisons found through the
+            // element type, like the ones of tree_adapter, aren't chosen instead.
+            friend bool operator==(relative_link const &lhs, relative_link const &rhs)
+            {
+                return static_cast<Node *>(lhs) == static_cast<Node *>(rhs);
+            }
+            friend bool operator==(relative_link const &lhs, Node *rhs)
+            {
+                return static_cast<Node *>(lhs) == rhs;
+            }
+            friend bool operator==(Node *lhs, relative_link const &rhs)
+            {
+                return lhs == static_cast<Node *>(rhs);
+            }
+            friend bool operator==(relative_link const &lhs, std::nullptr_t)
+            {
+                return !lhs.offset;
+            }
+            friend bool operator!=(relative_link const &lhs, relative_link const &rhs)
+            {
+                return !(lhs == rhs);
+            }
+            friend bool operator!=(relative_link const &lhs, Node *rhs)
+            {
+                return !(lhs == rhs);
+            }
+            friend bool operator!=(Node *lhs, relative_link const &rhs)
+            {
+                return !(lhs == rhs);
+            }
+            friend bool operator!=(relative_link const &lhs, std::nullptr_t)
+            {
+                return lhs.offset;
+            }
+
+        private:
+            static std::intptr_t address(void const *p)
+            {
+                return reinterpret_cast<std::intptr_t>(p);
+            }
+            std::int32_t offset = 0;
+        };
+
+        template <typename T>
+        struct compact_node
+        {
+            using value_type = T;
+
+            template <typename U, typename = std::enable_if_t<!std::is_same_v<std::decay_t<U>, compact_node>>>
+            explicit compact_node(U &&value)
+                : value(std::forward<U>(value))
+            {
+            }
+            compact_node(compact_node const &src)
+                : value(src.value)
+            {
+                copy_links(src);
+            }
+            compact_node(compact_node &&src) noexcept(std::is_nothrow_move_constructible_v<value_type>)
+                : value(std::move(src.value))
+            {
+                copy_links(src);
+            }
+            compact_node &operator=(compact_node const &src)
+            {
+                value = src.value;
+                return copy_links(src);
+            }
+            compact_node &operator=(compact_node &&src) noexcept(std::is_nothrow_move_assignable_v<value_type>)
+            {
+                value = std::move(src.value);
+                return copy_links(src);
+            }
+
+            value_type value;
+            relative_link<compact_node> left_child;
+            relative_link<compact_node> right_child;
+            relative_link<compact_node> parent;
+
+        private:
+            compact_node &copy_links(compact_node const &src)
+            {
+                left_child.copy_offset(src.left_child);
+                right_child.copy_offset(src.right_child);
+                parent.copy_offset(src.parent);
+                return *this;
+            }
+        };
+
+        // Binary tree keeping all nodes in one vector, linked by 32-bit relative offsets.
+        // Nodes can only be added; growing the storage invalidates iterators like std::vector does.
+        template <typename T>
+        class compact_tree
+        {
+            using default_order = preorder_t;
+            using default_direction = left_first_t;
+        public:
+            using value_type = T;
+            using node_type = compact_node<value_type>;
+            using size_type = std::size_t;
+
+        private:
+            template <typename, typename, typename, bool>
+            friend class tree_iterator;
+
+        public:
+            template <typename order_t, typename direction_t>
+            using iterator = tree_iterator<compact_tree, order_t, direction_t, false>;
+            template <typename order_t, typename direction_t>
+            using const_iterator = tree_iterator<compact_tree, order_t, direction_t, true>;
+
+            compact_tree() = default;
+            // Lays the nodes of src out in preorder, so that preorder walks run through memory sequentially.
+            template <typename Allocator, typename Augment>
+            explicit compact_tree(binary_tree<value_type, Allocator, Augment> const &src)
+            {
+                using source_iter = decltype(src.begin(preorder));
+                auto count = static_cast<size_type>(std::distance(src.begin(preorder), src.end(preorder)));
+                if (count > max_size())
+                    throw std::length_error("compact_tree can't address more nodes.");
+                reserve(count);
+                std::vector<std::pair<source_iter, node_type *>> path;
+                for (auto iter = src.begin(preorder); iter != src.end(preorder); ++iter)
+                {
+                    nodes.emplace_back(*iter);
+                    auto current = &nodes.back();
+                    if (!path.empty())
+                    {
+                        while (path.back().first != iter.parent())
+                            path.pop_back();
+                        auto parent = path.back().second;
+                        current->parent = parent;
+                        if (path.back().first.first_child() == iter)
+                            parent->left_child = current;
+                        else
+                            parent->right_child = current;
+                    }
+                    path.emplace_back(iter, current);
+                }
+            }
+
+            template <typename order_t = default_order, typename direction_t = default_direction>
+            auto begin(order_t order = order_t{}, direction_t direction = direction_t{})
+            {
+                if (empty())
+                    return end(order, direction);
+                return get_iter<order_t, direction_t>(order_template<node_type, order_t, direction_t>::begin(root_node()));
+            }
+            template <typename order_t = default_order, typename direction_t = default_direction>
+            auto begin(order_t order = order_t{}, direction_t direction = direction_t{}) const
+            {
+                if (empty())
+                    return end(order, direction);
+                return get_const_iter<order_t, direction_t>(order_template<node_type, order_t, direction_t>::begin(root_node()));
+            }
+            template <typename order_t = default_order, typename direction_t = default_direction>
+            auto cbegin(order_t order = order_t{}, direction_t direction = direction_t{}) const
+            {
+                return begin(order, direction);
+            }
+            template <typename order_t = default_order, typename direction_t = default_direction>
+            auto end(order_t = order_t{}, direction_t = direction_t{})
+            {
+                return get_iter<order_t, direction_t>(nullptr);
+            }
+            template <typename order_t = default_order, typename direction_t = default_direction>
+            auto end(order_t = order_t{}, direction_t = direction_t{}) const
+            {
+                return get_const_iter<order_t, direction_t>(nullptr);
+            }
+            template <typename order_t = default_order, typename direction_t = default_direction>
+            auto cend(order_t = order_t{}, direction_t = direction_t{}) const
+            {
+                return get_const_iter<order_t, direction_t>(nullptr);
+            }
+            template <typename order_t = default_order, typename direction_t = default_direction>
+            auto root(order_t = order_t{}, direction_t = direction_t{})
+            {
+                return get_iter<order_t, direction_t>(root_node());
+            }
+            template <typename order_t = default_order, typename direction_t = default_direction>
+            auto root(order_t = order_t{}, direction_t = direction_t{}) const
+            {
+                return get_const_iter<order_t, direction_t>(root_node());
+            }
+
+            bool empty() const
+            {
+                return nodes.empty();
+            }
+            size_type size() const
+            {
+                return nodes.size();
+            }
+            static constexpr size_type max_size()
+            {
+                return std::numeric_limits<std::int32_t>::max() / sizeof(node_type);
+            }
+            void reserve(size_type n)
+            {
+                nodes.reserve(n);
+            }
+            void clear()
+            {
+                nodes.clear();
+            }
+
+            template <typename U>
+            void set_root(U &&u)
+            {
+                nodes.clear();
+                nodes.emplace_back(std::forward<U>(u));
+            }
+            template <typename direction, typename iter, typename U>
+            iter new_child(iter parent, U &&u, direction = direction{})
+            {
+                assert(!iterate_direction<direction>::first_child(parent.node));
+                if (nodes.size() == max_size())
+                    throw std::length_error("compact_tree can't address more nodes.");
+                auto parent_index = parent.node - nodes.data();
+                nodes.emplace_back(std::forward<U>(u));
+                auto parent_node = &nodes[parent_index];
+                auto child = &nodes.back();
+                iterate_direction<direction>::first_child(parent_node) = child;
+                child->parent = parent_node;
+                return iter(this, child);
+            }
+
+            friend bool operator==(compact_tree const &lhs, compact_tree const &rhs)
+            {
+                auto left_iter = lhs.begin(preorder), right_iter = rhs.begin(preorder);
+                for (; left_iter != lhs.end() && right_iter != rhs.end(); ++left_iter, ++right_iter)
+                {
+                    if (*left_iter != *right_iter)
+                        return false;
+                    if (!left_iter.first_child() != !right_iter.first_child() || !left_iter.second_child() != !right_iter.second_child())
+                        return false;
+                }
+                return left_iter == right_iter;
+            }
+
+        private:
+            template <typename default_order, typename default_direction>
+            auto get_iter(node_type *p)
+            {
+                return iterator<default_order, default_direction>{this, p};
+            }
+            template <typename default_order, typename default_direction>
+            auto get_const_iter(node_type *p) const
+            {
+                return const_iterator<default_order, default_direction>{this, p};
+            }
+            node_type *root_node() const
+            {
+                return nodes.empty() ? nullptr : const_cast<node_type *>(nodes.data());
+            }
+
+            std::vector<node_type> nodes;
+        };
+    }
+}
+
+#endif //INC_201703_COMPACT_TREE_HPP
@@ -1,26 +1,36 @@
 #ifndef INC_201703_CONSOLE_UI_HPP
 #define INC_201703_CONSOLE_UI_HPP
 
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <functional>
 #include <stdexcept>
 #include <map>
+#include <optional>
+#include <limits>
+#include <sstream>
+#include <string_view>
+#include <variant>
+#include <vector>
 #include "tree_adapter.hpp"
 #include "save_load.hpp"
+#include "parallel.hpp"
+#include "string_pool.hpp"
 
 namespace ds_exp
 {
     inline namespace ui
     {
-        template <typename Key, typename Value = null_value_tag>
+        template <typename Key, typename Value = null_value_tag, typename Traits = default_adapter_traits>
         class console_ui
         {
-            using tree_type = tree_adapter<Key, Value>;
+            using tree_type = tree_adapter<Key, Value, Traits>;
             using map_type = std::map<std::string, tree_type>;
             using key_type = typename tree_type::key_type;
             using value_type = typename tree_type::value_type;
             using iterator_type = decltype(std::declval<tree_type>().Parent(std::declval<key_type>()));
+            using position_type = decltype(std::declval<tree_type &>().get_iterator(std::declval<key_type>()));
             struct bad_input : std::runtime_error
             {
                 using std::runtime_error::runtime_error;
@@ -53,6 +63,7 @@ namespace ds_exp
                     print_input(button);
                     try
                     {
+                        auto use = use_pool();
                         commands[button].act(*this);
                     }
                     catch (std::logic_error const &e)
@@ -72,13 +83,13 @@ namespace ds_exp
 
             void init()
             {
-                trees[current_tree_name].InitBiTree();
+                replace_tree([](tree_type &tree) { tree.InitBiTree(); });
                 print_ok();
             }
 
             void destroy()
             {
-                trees[current_tree_name].DestroyBiTree();
+                replace_tree([](tree_type &tree) { tree.DestroyBiTree(); });
                 print_ok();
             }
 
@@ -95,13 +106,13 @@ namespace ds_exp
                 std::cout << syntax_prompt;
                 auto definition = input_line<std::string>();
                 tree_type new_tree;
-                trees[current_tree_name].CreateBiTree(definition);
+                replace_tree([&definition](tree_type &tree) { tree.CreateBiTree(definition); });
                 print_ok();
             }
 
             void clear()
             {
-                trees[current_tree_name].ClearBiTree();
+                replace_tree([](tree_type &tree) { tree.ClearBiTree(); });
                 print_ok();
             }
 
@@ -140,7 +151,11 @@ namespace ds_exp
                 auto element = input_line<key_type>();
                 std::cout << "Please input the value to change to.\n";
                 auto value = input_line<value_type>();
-                trees[current_tree_name].Assign(element, value);
+                auto &tree = trees[current_tree_name];
+                auto pos = tree.get_iterator(element);
+                value_type former = get_value(*pos);
+                pos = tree.AssignAt(pos, value);
+                record(assign_delta{pos, std::move(former)});
                 print_ok();
             }
 
@@ -202,10 +217,8 @@ namespace ds_exp
                 auto definition = input_line<std::string>();
                 tree_type new_tree;
                 new_tree.CreateBiTree(definition);
-                if (select_right)
-                    trees[current_tree_name].InsertChild(iter, std::move(new_tree), right_child);
-                else
-                    trees[current_tree_name].InsertChild(iter, std::move(new_tree), left_child);
+                auto farest = insert_child(trees[current_tree_name], iter, std::move(new_tree), select_right);
+                record(insert_delta{iter, select_right != 0, farest, tree_type{}});
                 print_ok();
             }
 
@@ -216,11 +229,8 @@ namespace ds_exp
                 auto iter = trees[current_tree_name].get_iterator(element);
                 std::cout << "Please select left or right child to replace.(0 -->left, nozero --> right)\n";
                 auto select_right = input_value<int>();
-                tree_type deleted_tree;
-                if (select_right)
-                    deleted_tree = trees[current_tree_name].DeleteChild(iter, right_child);
-                else
-                    deleted_tree = trees[current_tree_name].DeleteChild(iter, left_child);
+                auto deleted_tree = delete_child(trees[current_tree_name], iter, select_right);
+                record(delete_delta{iter, select_right != 0, std::move(deleted_tree)});
                 print_ok();
             }
 
@@ -263,24 +273,38 @@ namespace ds_exp
 
             void save()
             {
-                std::ofstream file(save_file_name);
-                file << *this;
+                std::ofstream file(save_file_name, std::ios::binary);
+                write_container(file, *this);
                 if (file.good())
                     print_ok();
                 else
                     print_error();
             }
 
-            void load()
+            // Saves like save, with the trees in the binary form. load tells the forms apart.
+            void save_binary()
             {
-                std::ifstream file(save_file_name);
-                file >> *this;
+                std::ofstream file(save_file_name, std::ios::binary);
+                write_binary(file, *this);
                 if (file.good())
                     print_ok();
                 else
                     print_error();
             }
 
+            void load()
+            {
+                std::ifstream file(save_file_name, std::ios::binary);
+                if (file.peek() == std::char_traits<char>::to_int_type(container_magic[0]))
+                    read_container(file, *this);
+                else
+                    file >> *this;
+                if (!file.good())
+                    return print_error();
+                histories.clear();
+                print_ok();
+            }
+
             void add_tree()
             {
                 std::cout << "Please enter the name of the tree to add.\n";
@@ -317,6 +341,7 @@ namespace ds_exp
                 if (iter != trees.end())
                 {
                     trees.erase(iter);
+                    histories.erase(name);
                     if (name == current_tree_name)
                         current_tree_name = trees.begin()->first;
                     return print_ok();
@@ -324,6 +349,36 @@ namespace ds_exp
                 print_error();
             }
 
+            void undo()
+            {
+                auto &versions = histories[current_tree_name];
+                if (versions.version == 0)
+                    return print_error();
+                step(versions, false);
+                print_ok();
+            }
+
+            void redo()
+            {
+                auto &versions = histories[current_tree_name];
+                if (versions.version == versions.deltas.size())
+                    return print_error();
+                step(versions, true);
+                print_ok();
+            }
+
+            void checkout()
+            {
+                auto &versions = histories[current_tree_name];
+                std::cout << "Please input the version to check out. Version 0 is the tree before the first recorded change.\n";
+                auto version = input_value<std::size_t>(0, versions.deltas.size() + 1);
+                while (versions.version > version)
+                    step(versions, false);
+                while (versions.version < version)
+                    step(versions, true);
+                print_ok();
+            }
+
             void print_menu()
             {
                 std::cout << "Menu for binary tree sample\n";
@@ -338,6 +393,8 @@ namespace ds_exp
             void print_info()
             {
                 std::cout << "Current selected tree: " << current_tree_name << "\n";
+                auto &versions = histories[current_tree_name];
+                std::cout << "Version of the tree: " << versions.version << " of " << versions.deltas.size() << "\n";
                 std::cout << "Number of total trees: " << trees.size() << "\n";
             }
 
@@ -356,6 +413,15 @@ namespace ds_exp
                 return input_value<std::size_t>(start, std::numeric_limits<int>::max() - 1);
             }
 
+            // Makes the string pool of the registry current on the calling thread while the result lives.
+            std::optional<string_pool::scope> use_pool()
+            {
+                if constexpr (interns_strings)
+                    return std::optional<string_pool::scope>(std::in_place, strings);
+                else
+                    return std::nullopt;
+            }
+
             template <typename U>
             static auto input_line(std::istream &in = std::cin)
             {
@@ -455,9 +521,140 @@ namespace ds_exp
                 return {command{std::mem_fn(t.first), t.second}...};
             }
 
+            // A change of a tree, kept in its history instead of a copy of the tree, so undoing and redoing it costs
+            // about as much as the change did. Changes are only undone and redone in the state they were made in,
+            // which keeps the positions they refer to valid.
+            struct assign_delta
+            {
+                position_type pos;
+                value_type value;
+
+                // Assigning the kept value swaps it with the one in the tree, which undoes and redoes alike.
+                void undo(tree_type &tree)
+                {
+                    value_type current = get_value(*pos);
+                    pos = tree.AssignAt(pos, std::move(value));
+                    value = std::move(current);
+                }
+                void redo(tree_type &tree)
+                {
+                    undo(tree);
+                }
+            };
+            // InsertChild moved the former child below farest; the inserted subtree is kept while undone.
+            struct insert_delta
+            {
+                position_type pos;
+                bool right;
+                position_type farest;
+                tree_type inserted;
+
+                void undo(tree_type &tree)
+                {
+                    auto former = tree.DeleteChild(farest, right_child);
+                    inserted = delete_child(tree, pos, right);
+                    insert_child(tree, pos, std::move(former), right);
+                }
+                void redo(tree_type &tree)
+                {
+                    insert_child(tree, pos, std::move(inserted), right);
+                }
+            };
+            struct delete_delta
+            {
+                position_type pos;
+                bool right;
+                tree_type removed;
+
+                void undo(tree_type &tree)
+                {
+                    insert_child(tree, pos, std::move(removed), right);
+                }
+                void redo(tree_type &tree)
+                {
+                    removed = delete_child(tree, pos, right);
+                }
+            };
+            // Operations replacing the whole tree keep the tree they replaced.
+            struct replace_delta
+            {
+                tree_type other;
+
+                void undo(tree_type &tree)
+                {
+                    std::swap(tree, other);
+                }
+                void redo(tree_type &tree)
+                {
+                    std::swap(tree, other);
+                }
+            };
+            using delta = std::variant<assign_delta, insert_delta, delete_delta, replace_delta>;
+            struct history
+            {
+                std::vector<delta> deltas;
+                // Number of deltas applied to the tree.
+                std::size_t version = 0;
+            };
+
+            static position_type insert_child(tree_type &tree, position_type pos, tree_type inserted, bool right)
+            {
+                if (right)
+                    return tree.InsertChild(pos, std::move(inserted), right_child);
+                return tree.InsertChild(pos, std::move(inserted), left_child);
+            }
+            static tree_type delete_child(tree_type &tree, position_type pos, bool right)
+            {
+                if (right)
+                    return tree.DeleteChild(pos, right_child);
+                return tree.DeleteChild(pos, left_child);
+            }
+            // A new change drops the changes undone before it.
+            void record(delta change)
+            {
+                auto &versions = histories[current_tree_name];
+                versions.deltas.erase(versions.deltas.begin() + versions.version, versions.deltas.end());
+                versions.deltas.push_back(std::move(change));
+                ++versions.version;
+            }
+            void step(history &versions, bool forward)
+            {
+                auto &tree = trees[current_tree_name];
+                if (forward)
+                    std::visit([&tree](auto &change) { change.redo(tree); }, versions.deltas[versions.version++]);
+                else
+                    std::visit([&tree](auto &change) { change.undo(tree); }, versions.deltas[--versions.version]);
+            }
+            // The tree replaced by operation is handed over to the history instead of being destroyed. The moved-from
+            // tree left behind is empty, or doesn't exist if there was no tree, so operation sees the same preconditions.
+            template <typename Operation>
+            void replace_tree(Operation operation)
+            {
+                auto &current = trees[current_tree_name];
+                tree_type replaced = std::move(current);
+                try
+                {
+                    operation(current);
+                }
+                catch (...)
+                {
+                    current = std::move(replaced);
+                    throw;
+                }
+                record(replace_delta{std::move(replaced)});
+            }
+
+            // Interned keys and values live in a pool of the registry, which is declared first so it outlives the trees.
+            // It is only current on a thread while that thread works for the registry, see use_pool.
+            struct no_interning
+            {
+            };
+            static constexpr bool interns_strings = std::is_same_v<Key, interned_string> || std::is_same_v<Value, interned_string>;
+            std::conditional_t<interns_strings, string_pool, no_interning> strings;
             bool quit = false;
             std::string current_tree_name = "default";
             map_type trees;
+            std::map<std::string, history> histories;
 
             inline static auto commands = make_commands(std::pair{&console_ui::exit, "Exit"},
                                                         std::pair{&console_ui::init, "InitBiTree"},
@@ -482,9 +679,14 @@ namespace ds_exp
                                                         std::pair{&console_ui::load, "Load"},
                                                         std::pair{&console_ui::add_tree, "AddTree"},
                                                         std::pair{&console_ui::select_tree, "SelectTree"},
-                                                        std::pair{&console_ui::remove_tree, "RemoveTree"}
+                                                        std::pair{&console_ui::remove_tree, "RemoveTree"},
+                                                        std::pair{&console_ui::undo, "Undo"},
+                                                        std::pair{&console_ui::redo, "Redo"},
+                                                        std::pair{&console_ui::checkout, "CheckoutVersion"},
+                                                        std::pair{&console_ui::save_binary, "SaveBinary"}
             );
             inline static const std::string save_file_name = "data.save";
+            inline static const std::string container_magic = "\x89" "BTC";
 
             template <typename U>
             static void print_input(U const &value)
@@ -506,19 +708,121 @@ namespace ds_exp
                 return out;
             }
 
-            friend std::istream &operator>>(std::istream &in, console_ui &ui)
+            friend std::ostream &write_binary(std::ostream &out, console_ui const &ui)
+            {
+                out << ui.current_tree_name << "\n";
+                out << ui.trees.size() << "\n";
+                for (auto iter = ui.trees.begin(); iter != ui.trees.end(); ++iter)
+                {
+                    out << iter->first << "\n";
+                    write_binary(out, iter->second) << "\n";
+                }
+                return out;
+            }
+
+            // Container of all trees: a header with the offset and the size of every tree in the region after it,
+            // then the trees, each in its own region. The trees are printed concurrently, each into a string of its
+            // own, and the strings are written one after another.
+            friend std::ostream &write_container(std::ostream &out, console_ui const &ui)
             {
+                std::vector<typename map_type::const_iterator> entries;
+                for (auto iter = ui.trees.begin(); iter != ui.trees.end(); ++iter)
+                    entries.push_back(iter);
+                std::vector<std::string> regions(entries.size());
+                thread_pool::shared().for_each_index(entries.size(), [&](std::size_t i) {
+                    std::ostringstream region;
+                    region << entries[i]->second;
+                    regions[i] = region.str();
+                });
+                out << container_magic << "\n" << ui.current_tree_name << "\n" << entries.size() << "\n";
+                std::size_t offset = 0;
+                for (std::size_t i = 0; i < entries.size(); ++i)
+                {
+                    out << entries[i]->first << "\n" << offset << " " << regions[i].size() << "\n";
+                    offset += regions[i].size();
+                }
+                for (auto &region : regions)
+                    out.write(region.data(), std::streamsize(region.size()));
+                return out;
+            }
+            // Reads the regions at once and parses the trees concurrently. The header is checked against the size
+            // of the stream before anything is allocated for it, and the trees of ui are only replaced when all of
+            // them have been read.
+            friend std::istream &read_container(std::istream &in, console_ui &ui)
+            {
+                auto start = in.tellg();
+                in.seekg(0, std::ios::end);
+                auto end = in.tellg();
+                in.seekg(start);
+                if (start == std::istream::pos_type(-1) || end == std::istream::pos_type(-1) ||
+                    ui.input_line<std::string>(in) != container_magic)
+                {
+                    in.setstate(std::ios::failbit);
+                    return in;
+                }
+                auto current_tree_name = ui.input_line<std::string>(in);
+                auto size = ui.input_line<std::size_t>(in);
+                if (!in || size > std::size_t(end - start))
+                {
+                    in.setstate(std::ios::failbit);
+                    return in;
+                }
+                std::vector<std::string> names(size);
+                std::vector<std::pair<std::size_t, std::size_t>> places(size);
+                for (std::size_t i = 0; i < size && in; ++i)
+                {
+                    ui.input_line(in, names[i]);
+                    in >> places[i].first >> places[i].second;
+                    eat_line(in);
+                }
+                if (!in)
+                    return in;
+                auto available = std::size_t(end - in.tellg());
+                std::size_t regions_size = 0;
+                for (auto [offset, length] : places)
+                {
+                    if (length > available || offset > available - length)
+                    {
+                        in.setstate(std::ios::failbit);
+                        return in;
+                    }
+                    regions_size = std::max(regions_size, offset + length);
+                }
+                std::string regions(regions_size, '\0');
+                if (!in.read(regions.data(), std::streamsize(regions.size())))
+                    return in;
+                std::vector<console_ui::tree_type> read(size);
+                thread_pool::shared().for_each_index(size, [&](std::size_t i) {
+                    auto use = ui.use_pool();
+                    assign_element(std::string_view(regions).substr(places[i].first, places[i].second), read[i]);
+                });
                 ui.trees.clear();
-                std::string str;
-                ui.input_line(in, ui.current_tree_name);
+                for (std::size_t i = 0; i < size; ++i)
+                    ui.trees[names[i]] = std::move(read[i]);
+                ui.current_tree_name = std::move(current_tree_name);
+                return in;
+            }
+
+            // Like read_container, the trees of ui are only replaced when all of them have been read.
+            friend std::istream &operator>>(std::istream &in, console_ui &ui)
+            {
+                auto use = ui.use_pool();
+                map_type trees;
+                auto current_tree_name = ui.input_line<std::string>(in);
                 std::size_t size = 0;
                 ui.input_line(in, size);
-                for (std::size_t i = 0; i < size; ++i)
+                for (std::size_t i = 0; i < size && in; ++i)
                 {
                     auto name = ui.input_line<std::string>(in);
-                    auto tree = ui.input_line<console_ui::tree_type>(in);
-                    ui.trees[name] = tree;
+                    console_ui::tree_type tree;
+                    in >> tree;
+                    eat_line(in);
+                    trees[name] = std::move(tree);
                 }
+                if (!in)
+                    return in;
+                ui.trees = std::move(trees);
+                ui.current_tree_name = std::move(current_tree_name);
                 return in;
             }
         };
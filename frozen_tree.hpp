@@ -0,0 +1,240 @@
+#ifndef INC_201703_FROZEN_TREE_HPP
+#define INC_201703_FROZEN_TREE_HPP
+
+#include <cstddef>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "binary_tree.hpp"
+#include "compact_tree.hpp"
+
+namespace ds_exp
+{
+    inline namespace tree
+    {
+        // Breadth-first (Eytzinger) order: every level is stored contiguously, top level first.
+        struct bfs_layout_t
+        {
+            constexpr bfs_layout_t() = default;
+        };
+        // Van Emde Boas order: the top half of the levels is stored first, followed by each subtree hanging
+        // below it, all laid out the same way recursively. Any root-to-leaf walk touches O(log_B n) cache lines.
+        struct veb_layout_t
+        {
+            constexpr veb_layout_t() = default;
+        };
+        constexpr bfs_layout_t bfs_layout;
+        constexpr veb_layout_t veb_layout;
+
+        // Immutable snapshot of a binary_tree in a single allocation, nodes linked by 32-bit relative offsets.
+        // Offers the same traversal orders as binary_tree, through const iterators only.
+        template <typename T>
+        class frozen_tree
+        {
+            using default_order = preorder_t;
+            using default_direction = left_first_t;
+        public:
+            using value_type = T;
+            using node_type = compact_node<value_type>;
+            using size_type = std::size_t;
+
+        private:
+            template <typename, typename, typename, bool>
+            friend class tree_iterator;
+
+        public:
+            template <typename order_t, typename direction_t>
+            using const_iterator = tree_iterator<frozen_tree, order_t, direction_t, true>;
+            template <typename order_t, typename direction_t>
+            using iterator = const_iterator<order_t, direction_t>;
+
+            frozen_tree() = default;
+            template <typename Allocator, typename Augment, typename Layout = bfs_layout_t>
+            explicit frozen_tree(binary_tree<value_type, Allocator, Augment> const &src, Layout layout = Layout{})
+            {
+                if (src.empty())
+                    return;
+                auto source = breadth_first(src);
+                if (source.size() > max_size())
+                    throw std::length_error("frozen_tree can't address more nodes.");
+                auto order = layout_order(source, src.depth(), layout);
+                std::vector<std::size_t> slots(source.size());
+                nodes.reserve(order.size());
+                for (std::size_t i = 0; i < order.size(); ++i)
+                {
+                    slots[order[i]] = i;
+                    nodes.emplace_back(*source[order[i]].iter);
+                }
+                link(source, order, slots);
+            }
+
+            template <typename order_t = default_order, typename direction_t = default_direction>
+            auto begin(order_t order = order_t{}, direction_t direction = direction_t{}) const
+            {
+                if (empty())
+                    return end(order, direction);
+                return get_iter<order_t, direction_t>(order_template<node_type, order_t, direction_t>::begin(root_node()));
+            }
+            template <typename order_t = default_order, typename direction_t = default_direction>
+            auto cbegin(order_t order = order_t{}, direction_t direction = direction_t{}) const
+            {
+                return begin(order, direction);
+            }
+            template <typename order_t = default_order, typename direction_t = default_direction>
+            auto end(order_t = order_t{}, direction_t = direction_t{}) const
+            {
+                return get_iter<order_t, direction_t>(nullptr);
+            }
+            template <typename order_t = default_order, typename direction_t = default_direction>
+            auto cend(order_t = order_t{}, direction_t = direction_t{}) const
+            {
+                return get_iter<order_t, direction_t>(nullptr);
+            }
+            template <typename order_t = default_order, typename direction_t = default_direction>
+            auto root(order_t = order_t{}, direction_t = direction_t{}) const
+            {
+                return get_iter<order_t, direction_t>(root_node());
+            }
+
+            bool empty() const
+            {
+                return nodes.empty();
+            }
+            size_type size() const
+            {
+                return nodes.size();
+            }
+            static constexpr size_type max_size()
+            {
+                return compact_tree<value_type>::max_size();
+            }
+
+            friend bool operator==(frozen_tree const &lhs, frozen_tree const &rhs)
+            {
+                auto left_iter = lhs.begin(preorder), right_iter = rhs.begin(preorder);
+                for (; left_iter != lhs.end() && right_iter != rhs.end(); ++left_iter, ++right_iter)
+                {
+                    if (*left_iter != *right_iter)
+                        return false;
+                    if (!left_iter.first_child() != !right_iter.first_child() || !left_iter.second_child() != !right_iter.second_child())
+                        return false;
+                }
+                return left_iter == right_iter;
+            }
+
+        private:
+            template <typename Tree>
+            using source_iter = decltype(std::declval<Tree const &>().root());
+            // A node of the source with the links of its position in breadth-first order. The root is at position 0,
+            // so a child at position 0 means there is none.
+            template <typename Iter>
+            struct source_node
+            {
+                Iter iter;
+                std::size_t parent;
+                std::size_t children[2];
+            };
+
+            template <typename Tree>
+            static std::vector<source_node<source_iter<Tree>>> breadth_first(Tree const &src)
+            {
+                std::vector<source_node<source_iter<Tree>>> source{{src.root(), 0, {0, 0}}};
+                for (std::size_t i = 0; i < source.size(); ++i)
+                {
+                    auto iter = source[i].iter;
+                    if (auto child = iter.first_child())
+                    {
+                        source[i].children[0] = source.size();
+                        source.push_back({child, i, {0, 0}});
+                    }
+                    if (auto child = iter.second_child())
+                    {
+                        source[i].children[1] = source.size();
+                        source.push_back({child, i, {0, 0}});
+                    }
+                }
+                return source;
+            }
+
+            // The layouts list the breadth-first positions of the nodes in the order they are stored.
+            template <typename Source>
+            static std::vector<std::size_t> layout_order(Source const &source, std::size_t, bfs_layout_t)
+            {
+                std::vector<std::size_t> order(source.size());
+                for (std::size_t i = 0; i < order.size(); ++i)
+                    order[i] = i;
+                return order;
+            }
+            // Each pending entry is a subtree cut off `height` levels below its root. Splitting it pushes the
+            // subtrees below the cut in reverse, then the top part, so the top part is laid out first.
+            template <typename Source>
+            static std::vector<std::size_t> layout_order(Source const &source, std::size_t depth, veb_layout_t)
+            {
+                std::vector<std::size_t> order;
+                order.reserve(source.size());
+                std::vector<std::pair<std::size_t, std::size_t>> pending{{0, depth}};
+                std::vector<std::size_t> level, next_level;
+                while (!pending.empty())
+                {
+                    auto [subtree_root, height] = pending.back();
+                    pending.pop_back();
+                    if (height == 1)
+                    {
+                        order.push_back(subtree_root);
+                        continue;
+                    }
+                    auto top_height = height / 2;
+                    level.assign(1, subtree_root);
+                    for (std::size_t i = 0; i < top_height && !level.empty(); ++i)
+                    {
+                        next_level.clear();
+                        for (auto position : level)
+                            for (auto child : source[position].children)
+                                if (child)
+                                    next_level.push_back(child);
+                        std::swap(level, next_level);
+                    }
+                    for (auto iter = level.rbegin(); iter != level.rend(); ++iter)
+                        pending.emplace_back(*iter, height - top_height);
+                    pending.emplace_back(subtree_root, top_height);
+                }
+                return order;
+            }
+            // slots holds the slot of every breadth-first position, so each node finds its parent directly.
+            template <typename Source>
+            void link(Source const &source, std::vector<std::size_t> const &order, std::vector<std::size_t> const &slots)
+            {
+                for (std::size_t i = 1; i < order.size(); ++i)
+                {
+                    auto parent_position = source[order[i]].parent;
+                    auto &parent = nodes[slots[parent_position]];
+                    nodes[i].parent = &parent;
+                    if (source[parent_position].children[0] == order[i])
+                        parent.left_child = &nodes[i];
+                    else
+                        parent.right_child = &nodes[i];
+                }
+            }
+
+            template <typename default_order, typename default_direction>
+            auto get_iter(node_type *p) const
+            {
+                return const_iterator<default_order, default_direction>{this, p};
+            }
+            node_type *root_node() const
+            {
+                return nodes.empty() ? nullptr : const_cast<node_type *>(nodes.data());
+            }
+
+            std::vector<node_type> nodes;
+        };
+
+        template <typename Layout = bfs_layout_t, typename T, typename Allocator, typename Augment>
+        frozen_tree<T> freeze(binary_tree<T, Allocator, Augment> const &tree, Layout layout = Layout{})
+        {
+            return frozen_tree<T>(tree, layout);
+        }
+    }
+}
+
+#endif //INC_201703_FROZEN_TREE_HPP
@@ -2,7 +2,9 @@
 #include "test/test_binary_tree.hpp"
 #include "test/test_tree_parse.hpp"
 #include "test/test_tree_adapter.hpp"
+#include "test/test_deep_tree.hpp"
 #include "console_ui.hpp"
+#include "string_pool.hpp"
 
 int main()
 {
@@ -10,7 +12,8 @@ int main()
     test_binary_tree();
     test_tree_parse();
     test_tree_adapter();
-    ds_exp::console_ui<std::string, std::string> ui;
+    test_deep_tree(100000);
+    ds_exp::console_ui<ds_exp::interned_string, ds_exp::interned_string> ui;
     ui.execute();
     return 0;
 }
@@ -0,0 +1,480 @@
+#ifndef INC_201703_MAPPED_TREE_HPP
+#define INC_201703_MAPPED_TREE_HPP
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "binary_tree.hpp"
+#include "compact_tree.hpp"
+#include "binary_format.hpp"
+
+namespace ds_exp
+{
+    inline namespace tree
+    {
+        namespace detail
+        {
+            class string_table;
+        }
+
+        // Text kept in the string table of a mapped file, found by a byte offset from the handle itself, so it
+        // stays valid wherever the file is mapped. Copies refer to the same text.
+        class mapped_string
+        {
+        public:
+            mapped_string() = default;
+            mapped_string(mapped_string const &src)
+                : offset(src.offset + (address(&src) - address(this))), length(src.length)
+            {
+            }
+            mapped_string &operator=(mapped_string const &src)
+            {
+                offset = src.offset + (address(&src) - address(this));
+                length = src.length;
+                return *this;
+            }
+
+            std::size_t size() const
+            {
+                return std::size_t(length);
+            }
+            bool empty() const
+            {
+                return length == 0;
+            }
+            std::string_view view() const
+            {
+                return length ? std::string_view(reinterpret_cast<char const *>(this) + offset, std::size_t(length)) : std::string_view();
+            }
+            operator std::string_view() const
+            {
+                return view();
+            }
+            std::string str() const
+            {
+                return std::string(view());
+            }
+            // Whether the text lies within table, checked without forming a pointer outside of it.
+            bool inside(std::string_view table) const
+            {
+                if (length == 0)
+                    return true;
+                auto first = address(table.data()), target = address(this) + offset;
+                return target >= first && length <= table.size() && std::uint64_t(target - first) <= table.size() - length;
+            }
+
+            friend bool operator==(mapped_string const &lhs, mapped_string const &rhs)
+            {
+                return lhs.view() == rhs.view();
+            }
+            friend bool operator!=(mapped_string const &lhs, mapped_string const &rhs)
+            {
+                return lhs.view() != rhs.view();
+            }
+            friend bool operator<(mapped_string const &lhs, mapped_string const &rhs)
+            {
+                return lhs.view() < rhs.view();
+            }
+            // Templates, so that they are preferred over generic comparisons like the ones of tree_adapter.
+            template <typename S, typename = std::enable_if_t<std::is_convertible_v<S const &, std::string_view> && !std::is_same_v<S, mapped_string>>>
+            friend bool operator==(mapped_string const &lhs, S const &rhs)
+            {
+                return lhs.view() == std::string_view(rhs);
+            }
+            template <typename S, typename = std::enable_if_t<std::is_convertible_v<S const &, std::string_view> && !std::is_same_v<S, mapped_string>>>
+            friend bool operator==(S const &lhs, mapped_string const &rhs)
+            {
+                return std::string_view(lhs) == rhs.view();
+            }
+            template <typename S, typename = std::enable_if_t<std::is_convertible_v<S const &, std::string_view> && !std::is_same_v<S, mapped_string>>>
+            friend bool operator!=(mapped_string const &lhs, S const &rhs)
+            {
+                return lhs.view() != std::string_view(rhs);
+            }
+            template <typename S, typename = std::enable_if_t<std::is_convertible_v<S const &, std::string_view> && !std::is_same_v<S, mapped_string>>>
+            friend bool operator!=(S const &lhs, mapped_string const &rhs)
+            {
+                return std::string_view(lhs) != rhs.view();
+            }
+            friend std::ostream &operator<<(std::ostream &out, mapped_string const &s)
+            {
+                return out << s.view();
+            }
+
+        private:
+            friend class detail::string_table;
+
+            static std::int64_t address(void const *p)
+            {
+                return std::int64_t(reinterpret_cast<std::intptr_t>(p));
+            }
+
+            std::int64_t offset = 0;
+            std::uint64_t length = 0;
+        };
+
+        namespace detail
+        {
+            // Strings of a mapped file while it is written. Equal strings are stored once. The handles learn their
+            // offsets in link, when the place of the table in the file is known.
+            class string_table
+            {
+            public:
+                void add(std::string_view s, mapped_string &handle)
+                {
+                    handle.length = s.size();
+                    if (s.empty())
+                        return;
+                    auto [found, added] = positions.try_emplace(std::string(s), bytes.size());
+                    if (added)
+                        bytes.append(s);
+                    handles.emplace_back(&handle, found->second);
+                }
+                // Handles lie in the block of nodes starting at nodes, which is written at nodes_offset.
+                void link(void const *nodes, std::uint64_t nodes_offset, std::uint64_t strings_offset)
+                {
+                    for (auto [handle, position] : handles)
+                    {
+                        auto handle_offset = nodes_offset + std::uint64_t(reinterpret_cast<char const *>(handle) - static_cast<char const *>(nodes));
+                        handle->offset = std::int64_t(strings_offset + position) - std::int64_t(handle_offset);
+                    }
+                }
+                std::string_view data() const
+                {
+                    return bytes;
+                }
+
+            private:
+                std::string bytes;
+                std::unordered_map<std::string, std::uint64_t> positions;
+                std::vector<std::pair<mapped_string *, std::uint64_t>> handles;
+            };
+        }
+
+        // How an element of type T is stored in a mapped file: text becomes a mapped_string, trivially copyable
+        // types are stored as they are. Element types with parts specialize it with the flat form of the parts.
+        template <typename T, typename = void>
+        struct flat_value
+        {
+            static_assert(std::is_trivially_copyable_v<T>, "Elements of mapped trees are text or trivially copyable.");
+            using type = T;
+            static void store(T const &value, type &flat, detail::string_table &)
+            {
+                flat = value;
+            }
+            // Whether the text of flat lies in the string table of the file.
+            static bool fits(type const &, std::string_view)
+            {
+                return true;
+            }
+        };
+        template <typename T>
+        struct flat_value<T, std::enable_if_t<std::is_convertible_v<T const &, std::string_view>>>
+        {
+            using type = mapped_string;
+            static void store(T const &value, type &flat, detail::string_table &strings)
+            {
+                strings.add(value, flat);
+            }
+            static bool fits(type const &flat, std::string_view strings)
+            {
+                return flat.inside(strings);
+            }
+        };
+        template <typename T>
+        using flat_value_t = typename flat_value<T>::type;
+
+        namespace detail
+        {
+            // Start of a mapped file. The nodes follow at nodes_offset in preorder, linked by relative offsets,
+            // then the string table at strings_offset.
+            struct mapped_header
+            {
+                char magic[4];
+                std::uint32_t version;
+                std::uint64_t node_size;
+                std::uint64_t count;
+                std::uint64_t depth;
+                std::uint64_t nodes_offset;
+                std::uint64_t strings_offset;
+                std::uint64_t strings_size;
+            };
+            constexpr std::string_view mapped_magic("\x89" "BTM", 4);
+            constexpr std::uint32_t mapped_version = 1;
+
+            // Read-only private mapping of a whole file, unmapped when it goes away.
+            class file_mapping
+            {
+            public:
+                file_mapping() = default;
+                // Throws std::system_error if the file can't be mapped.
+                explicit file_mapping(std::string const &path)
+                {
+                    auto fd = ::open(path.c_str(), O_RDONLY);
+                    if (fd < 0)
+                        throw std::system_error(errno, std::generic_category(), "open " + path);
+                    struct stat status{};
+                    if (::fstat(fd, &status) != 0)
+                    {
+                        auto error = errno;
+                        ::close(fd);
+                        throw std::system_error(error, std::generic_category(), "stat " + path);
+                    }
+                    if (status.st_size == 0)
+                    {
+                        ::close(fd);
+                        return;
+                    }
+                    auto mapped = ::mmap(nullptr, std::size_t(status.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+                    auto error = errno;
+                    ::close(fd);
+                    if (mapped == MAP_FAILED)
+                        throw std::system_error(error, std::generic_category(), "mmap " + path);
+                    address = mapped;
+                    mapped_size = std::size_t(status.st_size);
+                }
+                file_mapping(file_mapping &&src) noexcept
+                    : address(std::exchange(src.address, nullptr)), mapped_size(std::exchange(src.mapped_size, 0))
+                {
+                }
+                file_mapping &operator=(file_mapping src) noexcept
+                {
+                    std::swap(address, src.address);
+                    std::swap(mapped_size, src.mapped_size);
+                    return *this;
+                }
+                ~file_mapping()
+                {
+                    if (address)
+                        ::munmap(address, mapped_size);
+                }
+
+                char *data() const
+                {
+                    return static_cast<char *>(address);
+                }
+                std::size_t size() const
+                {
+                    return mapped_size;
+                }
+
+            private:
+                void *address = nullptr;
+                std::size_t mapped_size = 0;
+            };
+        }
+
+        // Writes tree in the layout mapped_tree maps, for the processor the program runs on.
+        template <typename T, typename Allocator, typename Augment>
+        std::ostream &write_mapped(std::ostream &out, binary_tree<T, Allocator, Augment> const &tree)
+        {
+            using node_type = compact_node<flat_value_t<T>>;
+            using source_iter = decltype(tree.begin(preorder));
+            std::vector<node_type> nodes;
+            nodes.reserve(static_cast<std::size_t>(std::distance(tree.begin(preorder), tree.end(preorder))));
+            if (nodes.capacity() > compact_tree<flat_value_t<T>>::max_size())
+                throw std::length_error("mapped_tree can't address more nodes.");
+            detail::string_table strings;
+            std::vector<std::pair<source_iter, node_type *>> path;
+            for (auto iter = tree.begin(preorder); iter != tree.end(preorder); ++iter)
+            {
+                auto current = &nodes.emplace_back(flat_value_t<T>{});
+                flat_value<T>::store(*iter, current->value, strings);
+                if (!path.empty())
+                {
+                    while (path.back().first != iter.parent())
+                        path.pop_back();
+                    auto parent = path.back().second;
+                    current->parent = parent;
+                    if (path.back().first.first_child() == iter)
+                        parent->left_child = current;
+                    else
+                        parent->right_child = current;
+                }
+                path.emplace_back(iter, current);
+            }
+
+            detail::mapped_header header{};
+            std::memcpy(header.magic, detail::mapped_magic.data(), detail::mapped_magic.size());
+            header.version = detail::mapped_version;
+            header.node_size = sizeof(node_type);
+            header.count = nodes.size();
+            header.depth = tree.depth();
+            header.nodes_offset = (sizeof(header) + alignof(node_type) - 1) / alignof(node_type) * alignof(node_type);
+            header.strings_offset = header.nodes_offset + nodes.size() * sizeof(node_type);
+            header.strings_size = strings.data().size();
+            strings.link(nodes.data(), header.nodes_offset, header.strings_offset);
+            out.write(reinterpret_cast<char const *>(&header), sizeof(header));
+            out << std::string(std::size_t(header.nodes_offset - sizeof(header)), '\0');
+            out.write(reinterpret_cast<char const *>(nodes.data()), std::streamsize(nodes.size() * sizeof(node_type)));
+            return out << strings.data();
+        }
+
+        // Read-only view of a tree file written by write_mapped, mapped into memory instead of read. Opening it only
+        // checks the header, so it takes the same time for any size of tree and pages are read as the nodes are
+        // visited. Files from untrusted sources should be checked with validate before they are traversed. Offers
+        // the traversals of binary_tree through const iterators over flat_value_t<T>.
+        template <typename T>
+        class mapped_tree
+        {
+            using default_order = preorder_t;
+            using default_direction = left_first_t;
+        public:
+            using value_type = flat_value_t<T>;
+            using node_type = compact_node<value_type>;
+            using handler_type = node_type *;
+            using size_type = std::size_t;
+
+        private:
+            template <typename, typename, typename, bool>
+            friend class tree_iterator;
+
+        public:
+            template <typename order_t, typename direction_t>
+            using const_iterator = tree_iterator<mapped_tree, order_t, direction_t, true>;
+            template <typename order_t, typename direction_t>
+            using iterator = const_iterator<order_t, direction_t>;
+
+            mapped_tree() = default;
+            // Throws std::system_error if the file can't be mapped, corrupt_data if it isn't a mapped tree of T.
+            explicit mapped_tree(std::string const &path)
+                : mapping(path)
+            {
+                check_header();
+            }
+
+            template <typename order_t = default_order, typename direction_t = default_direction>
+            auto begin(order_t order = order_t{}, direction_t direction = direction_t{}) const
+            {
+                if (empty())
+                    return end(order, direction);
+                return get_iter<order_t, direction_t>(order_template<node_type, order_t, direction_t>::begin(root_node()));
+            }
+            template <typename order_t = default_order, typename direction_t = default_direction>
+            auto cbegin(order_t order = order_t{}, direction_t direction = direction_t{}) const
+            {
+                return begin(order, direction);
+            }
+            template <typename order_t = default_order, typename direction_t = default_direction>
+            auto end(order_t = order_t{}, direction_t = direction_t{}) const
+            {
+                return get_iter<order_t, direction_t>(nullptr);
+            }
+            template <typename order_t = default_order, typename direction_t = default_direction>
+            auto cend(order_t = order_t{}, direction_t = direction_t{}) const
+            {
+                return get_iter<order_t, direction_t>(nullptr);
+            }
+            template <typename order_t = default_order, typename direction_t = default_direction>
+            auto root(order_t = order_t{}, direction_t = direction_t{}) const
+            {
+                return get_iter<order_t, direction_t>(root_node());
+            }
+            template <typename order_t, typename direction_t, bool is_const>
+            static handler_type handler_of(tree_iterator<mapped_tree, order_t, direction_t, is_const> const &iter)
+            {
+                return iter.node;
+            }
+
+            bool empty() const
+            {
+                return size() == 0;
+            }
+            size_type size() const
+            {
+                return mapping.data() ? size_type(header().count) : 0;
+            }
+            // Stored when the file is written, so it is constant time.
+            std::size_t depth() const
+            {
+                return mapping.data() ? std::size_t(header().depth) : 0;
+            }
+
+            // Throws corrupt_data unless every link leads to a node of the file, children come after their parents
+            // in preorder and point back at them, and every text lies in the string table, so the links form one
+            // tree and traversals stay inside the mapping. It reads the whole file.
+            void validate() const
+            {
+                auto nodes = root_node();
+                auto count = size();
+                std::string_view strings(mapping.data() + header().strings_offset, std::size_t(header().strings_size));
+                auto index_of = [nodes, count](node_type const *p) {
+                    auto distance = reinterpret_cast<std::intptr_t>(p) - reinterpret_cast<std::intptr_t>(nodes);
+                    if (distance < 0 || distance % std::intptr_t(sizeof(node_type)) != 0 || std::size_t(distance) / sizeof(node_type) >= count)
+                        throw corrupt_data("link outside the nodes");
+                    return std::size_t(distance) / sizeof(node_type);
+                };
+                for (std::size_t i = 0; i < count; ++i)
+                {
+                    auto &node = nodes[i];
+                    if (i == 0 ? node.parent != nullptr : index_of(node.parent) >= i)
+                        throw corrupt_data("parent after its child");
+                    if (node.left_child != nullptr && node.left_child == node.right_child)
+                        throw corrupt_data("both children are the same node");
+                    for (node_type *child : {static_cast<node_type *>(node.left_child), static_cast<node_type *>(node.right_child)})
+                    {
+                        if (child && (index_of(child) <= i || child->parent != &node))
+                            throw corrupt_data("child doesn't link back to its parent");
+                    }
+                    if (i != 0)
+                    {
+                        node_type *parent = node.parent;
+                        if (parent->left_child != &node && parent->right_child != &node)
+                            throw corrupt_data("parent doesn't link to its child");
+                    }
+                    if (!flat_value<T>::fits(node.value, strings))
+                        throw corrupt_data("text outside the string table");
+                }
+            }
+        private:
+            detail::mapped_header const &header() const
+            {
+                return *reinterpret_cast<detail::mapped_header const *>(mapping.data());
+            }
+            void check_header() const
+            {
+                auto mapped_size = mapping.size();
+                if (mapped_size < sizeof(detail::mapped_header))
+                    throw corrupt_data("header cut off");
+                auto &h = header();
+                if (std::string_view(h.magic, sizeof h.magic) != detail::mapped_magic)
+                    throw corrupt_data("wrong magic");
+                if (h.version != detail::mapped_version)
+                    throw corrupt_data("unknown version");
+                if (h.node_size != sizeof(node_type) || h.nodes_offset % alignof(node_type) != 0)
+                    throw corrupt_data("nodes of another type");
+                if (h.nodes_offset < sizeof(h) || h.nodes_offset > mapped_size || h.count > (mapped_size - h.nodes_offset) / sizeof(node_type) ||
+                    h.strings_offset != h.nodes_offset + h.count * sizeof(node_type) || h.strings_size != mapped_size - h.strings_offset)
+                    throw corrupt_data("sizes don't match the file");
+            }
+            template <typename default_order, typename default_direction>
+            auto get_iter(node_type *p) const
+            {
+                return const_iterator<default_order, default_direction>{this, p};
+            }
+            // The mapping is read-only, so the nodes are never written through this pointer.
+            node_type *root_node() const
+            {
+                if (empty())
+                    return nullptr;
+                return reinterpret_cast<node_type *>(mapping.data() + header().nodes_offset);
+            }
+
+            detail::file_mapping mapping;
+        };
+    }
+}
+
+#endif //INC_201703_MAPPED_TREE_HPP
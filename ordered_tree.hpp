@@ -0,0 +1,129 @@
+#ifndef INC_201703_ORDERED_TREE_HPP
+#define INC_201703_ORDERED_TREE_HPP
+
+#include <cstddef>
+#include <functional>
+#include <utility>
+#include "binary_tree.hpp"
+
+namespace ds_exp
+{
+    inline namespace tree
+    {
+        // Searches in a binary search tree, i.e. a tree whose inorder sequence is sorted by compare.
+        // compare has to accept the elements and the key in either order. All of them take O(depth).
+        template <typename Tree, typename K, typename Compare = std::less<>>
+        auto bst_lower_bound(Tree &tree, K const &key, Compare compare = Compare{})
+        {
+            auto current = tree.root(inorder), bound = tree.end(inorder);
+            while (current)
+            {
+                if (compare(*current, key))
+                    current = current.second_child();
+                else
+                    bound = current, current = current.first_child();
+            }
+            return bound;
+        }
+        template <typename Tree, typename K, typename Compare = std::less<>>
+        auto bst_upper_bound(Tree &tree, K const &key, Compare compare = Compare{})
+        {
+            auto current = tree.root(inorder), bound = tree.end(inorder);
+            while (current)
+            {
+                if (compare(key, *current))
+                    bound = current, current = current.first_child();
+                else
+                    current = current.second_child();
+            }
+            return bound;
+        }
+        template <typename Tree, typename K, typename Compare = std::less<>>
+        auto bst_find(Tree &tree, K const &key, Compare compare = Compare{})
+        {
+            auto found = bst_lower_bound(tree, key, compare);
+            if (found && compare(key, *found))
+                return tree.end(inorder);
+            return found;
+        }
+
+        // AVL balancing on top of binary_tree::rotate. The heights come from height_augment, so the tree has to
+        // keep it; other augmentations are maintained by the rotations as usual.
+        // Restores the AVL property on the path from current up to the root.
+        template <typename Tree, typename Iter>
+        void avl_rebalance(Tree &tree, Iter current)
+        {
+            static_assert(has_augment<typename Tree::node_type, height_augment>, "AVL balancing needs height_augment.");
+            auto balance_of = [&tree](Iter const &iter) {
+                return static_cast<std::ptrdiff_t>(tree.subtree_depth(iter.first_child(left_child))) -
+                       static_cast<std::ptrdiff_t>(tree.subtree_depth(iter.first_child(right_child)));
+            };
+            while (current)
+            {
+                auto balance = balance_of(current);
+                if (balance > 1)
+                {
+                    if (balance_of(current.first_child(left_child)) < 0)
+                        tree.rotate(current.first_child(left_child).first_child(right_child));
+                    current = tree.rotate(current.first_child(left_child));
+                }
+                else if (balance < -1)
+                {
+                    if (balance_of(current.first_child(right_child)) > 0)
+                        tree.rotate(current.first_child(right_child).first_child(left_child));
+                    current = tree.rotate(current.first_child(right_child));
+                }
+                current = current == tree.root() ? tree.end(inorder) : current.parent();
+            }
+        }
+        // Inserts value unless an equivalent element is there already. Returns the inorder iterator to the element
+        // with that key and whether it was inserted.
+        template <typename Tree, typename U, typename Compare = std::less<>>
+        auto avl_insert(Tree &tree, U &&value, Compare compare = Compare{})
+        {
+            using iter_type = decltype(tree.root(inorder));
+            if (tree.empty())
+            {
+                tree.set_root(std::forward<U>(value));
+                return std::pair<iter_type, bool>(tree.root(inorder), true);
+            }
+            auto current = tree.root(inorder);
+            while (true)
+            {
+                if (compare(value, *current))
+                {
+                    if (!current.first_child(left_child))
+                    {
+                        auto inserted = tree.new_child(current, std::forward<U>(value), left_child);
+                        avl_rebalance(tree, current);
+                        return std::pair<iter_type, bool>(inserted, true);
+                    }
+                    current = current.first_child(left_child);
+                }
+                else if (compare(*current, value))
+                {
+                    if (!current.first_child(right_child))
+                    {
+                        auto inserted = tree.new_child(current, std::forward<U>(value), right_child);
+                        avl_rebalance(tree, current);
+                        return std::pair<iter_type, bool>(inserted, true);
+                    }
+                    current = current.first_child(right_child);
+                }
+                else
+                    return std::pair<iter_type, bool>(current, false);
+            }
+        }
+        // Erases the element at pos and returns the inorder iterator to the element after it.
+        template <typename Tree, typename Iter>
+        auto avl_erase(Tree &tree, Iter pos)
+        {
+            auto next = pos.change(inorder);
+            ++next;
+            avl_rebalance(tree, tree.erase(pos.change(inorder)));
+            return next;
+        }
+    }
+}
+
+#endif //INC_201703_ORDERED_TREE_HPP
@@ -0,0 +1,284 @@
+#ifndef INC_201703_PARALLEL_HPP
+#define INC_201703_PARALLEL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace ds_exp
+{
+    inline namespace parallel
+    {
+        class task_group;
+
+        // Work-stealing set of worker threads. Every worker owns a deque: it pushes and pops the tasks it forks at
+        // the back and idle threads steal the oldest task from the front of somebody else's deque. Threads outside
+        // the pool share one extra deque. Waiting threads run queued tasks instead of blocking, so a pool without
+        // workers simply runs everything on the caller.
+        class thread_pool
+        {
+            friend class task_group;
+        public:
+            explicit thread_pool(std::size_t workers = default_workers())
+            {
+                start(workers);
+            }
+            thread_pool(thread_pool const &) = delete;
+            thread_pool &operator=(thread_pool const &) = delete;
+            ~thread_pool()
+            {
+                stop();
+                if (is_shared)
+                    shared_destroyed = true;
+            }
+
+            static thread_pool &shared()
+            {
+                static thread_pool pool(default_workers(), true);
+                return pool;
+            }
+            // The shared pool, or nullptr once it has been destroyed at exit. For code that may run from the
+            // destructors of static objects, which can outlive the function-static pool.
+            static thread_pool *shared_if_alive()
+            {
+                return shared_destroyed ? nullptr : &shared();
+            }
+            static std::size_t default_workers()
+            {
+                auto cores = std::thread::hardware_concurrency();
+                return cores > 1 ? cores - 1 : 0;
+            }
+
+            std::size_t concurrency() const
+            {
+                return workers.size() + 1;
+            }
+            // Must not be called while tasks are running on the pool.
+            void resize(std::size_t count)
+            {
+                stop();
+                start(count);
+            }
+
+            // Calls callable(i) for every i in [0, n) and returns once all calls are done.
+            // The first exception thrown by a call is rethrown here.
+            template <typename Callable>
+            void for_each_index(std::size_t n, Callable callable);
+
+            // Runs one queued task on the calling thread: the newest one of its own deque if there is one,
+            // otherwise the oldest one of another deque. Returns false if there was nothing to run.
+            bool run_one()
+            {
+                std::function<void()> job;
+                if (!take(job))
+                    return false;
+                job();
+                return true;
+            }
+
+        private:
+            thread_pool(std::size_t workers, bool is_shared)
+                : is_shared(is_shared)
+            {
+                start(workers);
+            }
+
+            struct task_queue
+            {
+                std::mutex mutex;
+                std::deque<std::function<void()>> tasks;
+            };
+
+            std::size_t own_queue() const
+            {
+                return owner == this ? own_index : queues.size() - 1;
+            }
+            void submit(std::function<void()> job)
+            {
+                auto &queue = *queues[own_queue()];
+                {
+                    std::lock_guard<std::mutex> lock(queue.mutex);
+                    queue.tasks.push_back(std::move(job));
+                }
+                ++queued;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                }
+                wake.notify_one();
+            }
+            bool take(std::function<void()> &job)
+            {
+                if (queued == 0)
+                    return false;
+                auto own = own_queue();
+                {
+                    auto &queue = *queues[own];
+                    std::lock_guard<std::mutex> lock(queue.mutex);
+                    if (!queue.tasks.empty())
+                    {
+                        job = std::move(queue.tasks.back());
+                        queue.tasks.pop_back();
+                        --queued;
+                        return true;
+                    }
+                }
+                for (std::size_t i = 1; i < queues.size(); ++i)
+                {
+                    auto &queue = *queues[(own + i) % queues.size()];
+                    std::lock_guard<std::mutex> lock(queue.mutex);
+                    if (!queue.tasks.empty())
+                    {
+                        job = std::move(queue.tasks.front());
+                        queue.tasks.pop_front();
+                        --queued;
+                        return true;
+                    }
+                }
+                return false;
+            }
+            void start(std::size_t count)
+            {
+                stopping = false;
+                queues.clear();
+                for (std::size_t i = 0; i <= count; ++i)
+                    queues.push_back(std::make_unique<task_queue>());
+                for (std::size_t i = 0; i < count; ++i)
+                    workers.emplace_back([this, i] { run(i); });
+            }
+            void stop()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    stopping = true;
+                }
+                wake.notify_all();
+                for (auto &worker : workers)
+                    worker.join();
+                workers.clear();
+            }
+            void run(std::size_t index)
+            {
+                owner = this;
+                own_index = index;
+                while (true)
+                {
+                    if (run_one())
+                        continue;
+                    std::unique_lock<std::mutex> lock(mutex);
+                    wake.wait(lock, [this] { return stopping || queued != 0; });
+                    if (stopping && queued == 0)
+                        return;
+                }
+            }
+
+            inline static bool shared_destroyed = false;
+            inline static thread_local thread_pool const *owner = nullptr;
+            inline static thread_local std::size_t own_index = 0;
+
+            std::vector<std::thread> workers;
+            std::vector<std::unique_ptr<task_queue>> queues;
+            std::atomic<std::size_t> queued{0};
+            std::mutex mutex;
+            std::condition_variable wake;
+            bool stopping = false;
+            bool is_shared = false;
+        };
+
+        // Tasks forked onto a thread_pool and joined again. Joining runs queued tasks on the waiting thread
+        // until the group is done, so tasks can fork and join groups of their own from inside the pool.
+        class task_group
+        {
+        public:
+            explicit task_group(thread_pool &pool = thread_pool::shared())
+                : pool(pool)
+            {
+            }
+            task_group(task_group const &) = delete;
+            task_group &operator=(task_group const &) = delete;
+            ~task_group()
+            {
+                join();
+            }
+
+            template <typename Callable>
+            void run(Callable callable)
+            {
+                ++pending;
+                pool.submit([this, callable]() mutable {
+                    invoke(callable);
+                    --pending;
+                });
+            }
+            // Runs callable on the calling thread, then waits for the group.
+            template <typename Callable>
+            void run_and_wait(Callable callable)
+            {
+                invoke(callable);
+                wait();
+            }
+            // Returns once every task has finished. The first exception thrown by a task is rethrown here.
+            void wait()
+            {
+                join();
+                if (error)
+                    std::rethrow_exception(std::exchange(error, nullptr));
+            }
+
+        private:
+            template <typename Callable>
+            void invoke(Callable &callable)
+            {
+                try
+                {
+                    callable();
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (!error)
+                        error = std::current_exception();
+                }
+            }
+            void join()
+            {
+                while (pending != 0)
+                {
+                    if (!pool.run_one())
+                        std::this_thread::yield();
+                }
+            }
+
+            thread_pool &pool;
+            std::atomic<std::size_t> pending{0};
+            std::mutex mutex;
+            std::exception_ptr error;
+        };
+
+        template <typename Callable>
+        void thread_pool::for_each_index(std::size_t n, Callable callable)
+        {
+            if (n == 0)
+                return;
+            std::atomic<std::size_t> next{0};
+            auto work = [&] {
+                for (std::size_t i; (i = next++) < n;)
+                    callable(i);
+            };
+            task_group group(*this);
+            auto helpers = std::min(n - 1, workers.size());
+            for (std::size_t i = 0; i < helpers; ++i)
+                group.run(work);
+            group.run_and_wait(work);
+        }
+    }
+}
+
+#endif //INC_201703_PARALLEL_HPP
@@ -0,0 +1,463 @@
+#ifndef INC_201703_PERSISTENT_TREE_HPP
+#define INC_201703_PERSISTENT_TREE_HPP
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "binary_tree.hpp"
+
+namespace ds_exp
+{
+    inline namespace tree
+    {
+        template <typename T>
+        struct persistent_node
+        {
+            using value_type = T;
+
+            template <typename U>
+            explicit persistent_node(U &&value)
+                :value(std::forward<U>(value))
+            {
+            }
+
+            value_type value;
+            std::shared_ptr<persistent_node> left_child;
+            std::shared_ptr<persistent_node> right_child;
+        };
+
+        template <typename T, typename order_t, typename direction_t>
+        class persistent_iterator;
+
+        // Binary tree whose copies share all their nodes. Nodes are reference counted and have no parent links,
+        // so a copy takes O(1) and a mutation copies only the nodes on the path from the root down to the node it
+        // changes, and only those still shared with another tree. Many snapshots of a large tree thus cost little
+        // more memory than the tree itself. Iterators keep their path from the root instead of parent links.
+        // A mutation invalidates the iterators of the tree it is applied to; other copies keep theirs.
+        template <typename T>
+        class persistent_tree
+        {
+            using default_order = preorder_t;
+            using default_direction = left_first_t;
+        public:
+            using value_type = T;
+            using node_type = persistent_node<value_type>;
+            using size_type = std::size_t;
+
+        private:
+            using node_pointer = std::shared_ptr<node_type>;
+
+            template <typename, typename, typename>
+            friend class persistent_iterator;
+
+            explicit persistent_tree(node_pointer root)
+                :root_(std::move(root))
+            {
+            }
+        public:
+            template <typename order_t, typename direction_t>
+            using const_iterator = persistent_iterator<value_type, order_t, direction_t>;
+            template <typename order_t, typename direction_t>
+            using iterator = const_iterator<order_t, direction_t>;
+
+            persistent_tree() = default;
+            persistent_tree(persistent_tree const &) = default;
+            persistent_tree(persistent_tree &&) noexcept = default;
+            persistent_tree &operator=(persistent_tree const &src)
+            {
+                auto old_root = std::exchange(root_, src.root_);
+                release(std::move(old_root));
+                return *this;
+            }
+            persistent_tree &operator=(persistent_tree &&src) noexcept
+            {
+                auto old_root = std::exchange(root_, std::move(src.root_));
+                release(std::move(old_root));
+                return *this;
+            }
+            // Builds the nodes bottom-up in one postorder walk.
+            template <typename Allocator, typename Augment>
+            explicit persistent_tree(binary_tree<value_type, Allocator, Augment> const &src)
+            {
+                std::vector<node_pointer> built;
+                for (auto iter = src.begin(postorder); iter != src.end(postorder); ++iter)
+                {
+                    auto p = std::make_shared<node_type>(*iter);
+                    if (iter.second_child())
+                        p->right_child = pop(built);
+                    if (iter.first_child())
+                        p->left_child = pop(built);
+                    built.push_back(std::move(p));
+                }
+                if (!built.empty())
+                    root_ = pop(built);
+            }
+            ~persistent_tree()
+            {
+                release(std::move(root_));
+            }
+
+            template <typename order_t = default_order, typename direction_t = default_direction>
+            auto begin(order_t order = order_t{}, direction_t direction = direction_t{}) const
+            {
+                auto iter = root(order, direction);
+                if (iter)
+                    iter.descend_to_first();
+                return iter;
+            }
+            template <typename order_t = default_order, typename direction_t = default_direction>
+            auto cbegin(order_t order = order_t{}, direction_t direction = direction_t{}) const
+            {
+                return begin(order, direction);
+            }
+            template <typename order_t = default_order, typename direction_t = default_direction>
+            auto end(order_t = order_t{}, direction_t = direction_t{}) const
+            {
+                return const_iterator<order_t, direction_t>{};
+            }
+            template <typename order_t = default_order, typename direction_t = default_direction>
+            auto cend(order_t order = order_t{}, direction_t direction = direction_t{}) const
+            {
+                return end(order, direction);
+            }
+            template <typename order_t = default_order, typename direction_t = default_direction>
+            auto root(order_t = order_t{}, direction_t = direction_t{}) const
+            {
+                const_iterator<order_t, direction_t> iter;
+                if (root_)
+                    iter.path.push_back(root_.get());
+                return iter;
+            }
+
+            bool empty() const
+            {
+                return !root_;
+            }
+            size_type size() const
+            {
+                return static_cast<size_type>(std::distance(begin(), end()));
+            }
+            std::size_t depth() const
+            {
+                std::size_t max_depth = 0;
+                std::vector<std::pair<node_type const *, std::size_t>> pending;
+                if (root_)
+                    pending.emplace_back(root_.get(), 1);
+                while (!pending.empty())
+                {
+                    auto [p, depth] = pending.back();
+                    pending.pop_back();
+                    max_depth = std::max(max_depth, depth);
+                    if (p->left_child)
+                        pending.emplace_back(p->left_child.get(), depth + 1);
+                    if (p->right_child)
+                        pending.emplace_back(p->right_child.get(), depth + 1);
+                }
+                return max_depth;
+            }
+            // Whether both trees share every node, which makes them equal without comparing anything.
+            bool shares_root_with(persistent_tree const &other) const
+            {
+                return root_ == other.root_;
+            }
+
+            template <typename Allocator = std::allocator<value_type>>
+            binary_tree<value_type, Allocator> to_binary_tree(Allocator const &alloc = Allocator{}) const
+            {
+                binary_tree<value_type, Allocator> result(alloc);
+                if (empty())
+                    return result;
+                result.set_root(root_->value);
+                std::vector<std::pair<node_type const *, decltype(result.root())>> pending{{root_.get(), result.root()}};
+                while (!pending.empty())
+                {
+                    auto [p, parent] = pending.back();
+                    pending.pop_back();
+                    if (p->left_child)
+                        pending.emplace_back(p->left_child.get(), result.new_child(parent, p->left_child->value, left_child, defer_update));
+                    if (p->right_child)
+                        pending.emplace_back(p->right_child.get(), result.new_child(parent, p->right_child->value, right_child, defer_update));
+                }
+                result.update_augment();
+                return result;
+            }
+            // A tree sharing the subtree rooted at pos, in O(1).
+            template <typename order_t, typename direction_t>
+            persistent_tree subtree(const_iterator<order_t, direction_t> const &pos) const
+            {
+                if (!pos)
+                    return persistent_tree();
+                if (pos.path.size() == 1)
+                    return *this;
+                return persistent_tree(slot_of(pos.path[pos.path.size() - 2], pos.path.back()));
+            }
+
+            template <typename U>
+            void set_root(U &&u)
+            {
+                auto old_root = std::exchange(root_, std::make_shared<node_type>(std::forward<U>(u)));
+                release(std::move(old_root));
+            }
+            void clear()
+            {
+                release(std::move(root_));
+            }
+            // Each mutation returns an iterator to the node it changed, valid in this tree.
+            template <typename order_t, typename direction_t, typename U>
+            auto assign(const_iterator<order_t, direction_t> const &pos, U &&u)
+            {
+                auto writable = unshare(pos);
+                writable.path.back()->value = std::forward<U>(u);
+                return writable;
+            }
+            template <typename direction, typename order_t, typename direction_t, typename U>
+            auto new_child(const_iterator<order_t, direction_t> const &parent, U &&u, direction = direction{})
+            {
+                auto writable = unshare(parent);
+                auto &child = iterate_direction<direction>::first_child(writable.path.back());
+                auto old_child = std::exchange(child, std::make_shared<node_type>(std::forward<U>(u)));
+                release(std::move(old_child));
+                writable.path.push_back(child.get());
+                return writable;
+            }
+            // Hangs tree below parent in O(depth) without copying it, and returns the subtree that was there.
+            template <typename direction, typename order_t, typename direction_t>
+            persistent_tree replace_child(const_iterator<order_t, direction_t> const &parent, persistent_tree tree, direction = direction{})
+            {
+                auto writable = unshare(parent);
+                auto &child = iterate_direction<direction>::first_child(writable.path.back());
+                return persistent_tree(std::exchange(child, std::move(tree.root_)));
+            }
+            template <typename direction, typename order_t, typename direction_t>
+            persistent_tree remove_child(const_iterator<order_t, direction_t> const &parent, direction = direction{})
+            {
+                return replace_child(parent, persistent_tree(), direction{});
+            }
+
+            friend bool operator==(persistent_tree const &lhs, persistent_tree const &rhs)
+            {
+                // Subtrees shared by both trees are skipped.
+                std::vector<std::pair<node_type const *, node_type const *>> pending{{lhs.root_.get(), rhs.root_.get()}};
+                while (!pending.empty())
+                {
+                    auto [left, right] = pending.back();
+                    pending.pop_back();
+                    if (left == right)
+                        continue;
+                    if (!left || !right || !(left->value == right->value))
+                        return false;
+                    pending.emplace_back(left->left_child.get(), right->left_child.get());
+                    pending.emplace_back(left->right_child.get(), right->right_child.get());
+                }
+                return true;
+            }
+            friend bool operator!=(persistent_tree const &lhs, persistent_tree const &rhs)
+            {
+                return !(lhs == rhs);
+            }
+
+        private:
+            static node_pointer pop(std::vector<node_pointer> &stack)
+            {
+                auto p = std::move(stack.back());
+                stack.pop_back();
+                return p;
+            }
+            static node_pointer &slot_of(node_type *parent, node_type const *child)
+            {
+                return parent->left_child.get() == child ? parent->left_child : parent->right_child;
+            }
+            // Copies the nodes on the path to pos that are shared with another tree, so they can be changed
+            // without the other trees noticing. A node below a copied one is shared by the copy, so it's copied too.
+            template <typename order_t, typename direction_t>
+            const_iterator<order_t, direction_t> unshare(const_iterator<order_t, direction_t> const &pos)
+            {
+                assert(pos);
+                auto writable = pos;
+                auto *slot = &root_;
+                for (std::size_t i = 0; i < writable.path.size(); ++i)
+                {
+                    if (i != 0)
+                        slot = &slot_of(writable.path[i - 1], pos.path[i]);
+                    if (slot->use_count() > 1)
+                        *slot = std::make_shared<node_type>(std::as_const(**slot));
+                    writable.path[i] = slot->get();
+                }
+                return writable;
+            }
+            // Drops a reference to a subtree. Nodes only referred to from here are taken apart one at a time,
+            // so freeing a deep tree doesn't recurse through the destructors.
+            static void release(node_pointer p)
+            {
+                std::vector<node_pointer> pending;
+                pending.push_back(std::move(p));
+                while (!pending.empty())
+                {
+                    auto current = pop(pending);
+                    if (current && current.use_count() == 1)
+                    {
+                        pending.push_back(std::move(current->left_child));
+                        pending.push_back(std::move(current->right_child));
+                    }
+                }
+            }
+
+            node_pointer root_;
+        };
+
+        // Forward iterator over a persistent_tree. It holds the path from the root to its node, which also
+        // serves the child and parent steps.
+        template <typename T, typename order, typename direction>
+        class persistent_iterator
+        {
+            template <typename>
+            friend class persistent_tree;
+
+            using node_type = persistent_node<T>;
+            using dir = iterate_direction<direction>;
+        public:
+            using value_type = T;
+            using difference_type = std::ptrdiff_t;
+            using pointer = value_type const *;
+            using reference = value_type const &;
+            using iterator_category = std::forward_iterator_tag;
+
+            persistent_iterator() = default;
+
+            reference operator*() const
+            {
+                return path.back()->value;
+            }
+            pointer operator->() const
+            {
+                return &path.back()->value;
+            }
+            explicit operator bool() const
+            {
+                return !path.empty();
+            }
+            persistent_iterator &operator++()
+            {
+                next(order{});
+                return *this;
+            }
+            persistent_iterator operator++(int)
+            {
+                auto old = *this;
+                ++*this;
+                return old;
+            }
+            template <typename direction_t = direction>
+            persistent_iterator first_child(direction_t = direction_t{}) const
+            {
+                return child(iterate_direction<direction_t>::first_child(path.back()).get());
+            }
+            template <typename direction_t = direction>
+            persistent_iterator second_child(direction_t = direction_t{}) const
+            {
+                return child(iterate_direction<direction_t>::second_child(path.back()).get());
+            }
+            persistent_iterator parent() const
+            {
+                auto result = *this;
+                result.path.pop_back();
+                return result;
+            }
+            template <typename order_t>
+            persistent_iterator<T, order_t, direction> change(order_t = order_t{}) const
+            {
+                persistent_iterator<T, order_t, direction> result;
+                result.path = path;
+                return result;
+            }
+
+            friend bool operator==(persistent_iterator const &lhs, persistent_iterator const &rhs)
+            {
+                return lhs.path.empty() ? rhs.path.empty() : !rhs.path.empty() && lhs.path.back() == rhs.path.back();
+            }
+            friend bool operator!=(persistent_iterator const &lhs, persistent_iterator const &rhs)
+            {
+                return !(lhs == rhs);
+            }
+
+        private:
+            template <typename, typename, typename>
+            friend class persistent_iterator;
+
+            persistent_iterator child(node_type *p) const
+            {
+                if (!p)
+                    return persistent_iterator();
+                auto result = *this;
+                result.path.push_back(p);
+                return result;
+            }
+            node_type *top() const
+            {
+                return path.back();
+            }
+            node_type *up() const
+            {
+                return path.size() > 1 ? path[path.size() - 2] : nullptr;
+            }
+            void push(std::shared_ptr<node_type> const &p)
+            {
+                path.push_back(p.get());
+            }
+            void descend_to_first()
+            {
+                if constexpr (std::is_same_v<order, inorder_t>)
+                {
+                    while (dir::first_child(top()))
+                        push(dir::first_child(top()));
+                }
+                else if constexpr (std::is_same_v<order, postorder_t>)
+                {
+                    while (dir::first_child(top()) || dir::second_child(top()))
+                        push(dir::first_child(top()) ? dir::first_child(top()) : dir::second_child(top()));
+                }
+            }
+            void next(preorder_t)
+            {
+                if (dir::first_child(top()))
+                    return push(dir::first_child(top()));
+                if (dir::second_child(top()))
+                    return push(dir::second_child(top()));
+                while (up() && (dir::second_child(up()).get() == top() || !dir::second_child(up())))
+                    path.pop_back();
+                path.pop_back();
+                if (!path.empty())
+                    push(dir::second_child(top()));
+            }
+            void next(inorder_t)
+            {
+                if (dir::second_child(top()))
+                {
+                    push(dir::second_child(top()));
+                    return descend_to_first();
+                }
+                while (up() && dir::second_child(up()).get() == top())
+                    path.pop_back();
+                path.pop_back();
+            }
+            void next(postorder_t)
+            {
+                auto p = up();
+                if (p && dir::first_child(p).get() == top() && dir::second_child(p))
+                {
+                    path.back() = dir::second_child(p).get();
+                    return descend_to_first();
+                }
+                path.pop_back();
+            }
+
+            std::vector<node_type *> path;
+        };
+    }
+}
+
+#endif //INC_201703_PERSISTENT_TREE_HPP
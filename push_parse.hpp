@@ -0,0 +1,237 @@
+#ifndef INC_201703_PUSH_PARSE_HPP
+#define INC_201703_PUSH_PARSE_HPP
+
+#include <cctype>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "tree_parse.hpp"
+
+namespace ds_exp
+{
+    inline namespace parse
+    {
+        // Parses a tree definition handed over in chunks of any size, keeping its state between the calls, so the
+        // text can be parsed while it is still being read. Besides the tree, only the unfinished ancestors of
+        // the current node and the text of the current element are kept.
+        template <typename direction, typename T, typename Allocator = std::allocator<T>, typename Augment = no_augment>
+        class push_parse
+        {
+            using tree_type = binary_tree<T, Allocator, Augment>;
+            using value_type = typename tree_type::value_type;
+            using iter_type = decltype(std::declval<tree_type &>().root(preorder, direction{}));
+
+        public:
+            explicit push_parse(Allocator const &alloc = Allocator())
+                : tree(alloc)
+            {
+            }
+            // The pending iterators refer to the tree member.
+            push_parse(push_parse const &) = delete;
+            push_parse &operator=(push_parse const &) = delete;
+
+            // callable(iter) is called with the root of every subtree once its last element has arrived, children
+            // before their parents. The augmentation is only computed when the whole tree is complete.
+            template <typename Callable>
+            void on_subtree(Callable callable)
+            {
+                finished = std::move(callable);
+            }
+
+            // Parses as much of chunk as belongs to the definition and returns the number of characters used,
+            // which is less than the size of chunk only when the closing ']' is in it.
+            std::size_t feed(std::string_view chunk)
+            {
+                std::size_t used = 0;
+                while (used != chunk.size() && state != states::done)
+                    step(chunk[used++]);
+                return used;
+            }
+            bool done() const
+            {
+                return state == states::done;
+            }
+            // The parsed tree, or std::nullopt for "[null]". Throws unexpected_end if the definition is incomplete.
+            std::optional<tree_type> get_binary_tree()
+            {
+                if (!done())
+                    throw unexpected_end();
+                if (tree.empty())
+                    return std::nullopt;
+                tree.update_augment();
+                return std::move(tree);
+            }
+
+        private:
+            enum class states
+            {
+                open,
+                element_start,
+                paren_element,
+                after_paren,
+                bare_element,
+                done
+            };
+            // first_filled and second_filled tell which child slots have been read.
+            struct pending_node
+            {
+                iter_type iter;
+                bool first_filled;
+                bool second_filled;
+            };
+
+            static bool is_space(char c)
+            {
+                return std::isspace(static_cast<unsigned char>(c));
+            }
+            void step(char c)
+            {
+                switch (state)
+                {
+                    case states::open:
+                        if (is_space(c))
+                            return;
+                        if (c != '[')
+                            throw expect_failed("[");
+                        state = states::element_start;
+                        return;
+                    case states::element_start:
+                        if (is_space(c))
+                            return;
+                        element.clear();
+                        if (c == '(')
+                            state = states::paren_element;
+                        else
+                        {
+                            state = states::bare_element;
+                            step(c);
+                        }
+                        return;
+                    case states::paren_element:
+                        if (read_escaped(c, ')'))
+                        {
+                            add_element(true);
+                            state = states::after_paren;
+                        }
+                        return;
+                    case states::after_paren:
+                        if (is_space(c))
+                            return;
+                        separate(c);
+                        return;
+                    case states::bare_element:
+                        if (read_escaped(c, ',', ']'))
+                        {
+                            if (element.compare(0, 4, "null") == 0)
+                            {
+                                if (element.find_first_not_of(" \t\n\v\f\r", 4) != std::string::npos)
+                                    throw expect_failed(",");
+                                element.clear();
+                                add_element(false);
+                            }
+                            else
+                                add_element(true);
+                            separate(c);
+                        }
+                        return;
+                    case states::done:
+                        return;
+                }
+            }
+            // Appends c to the element unless it ends it. A backslash escapes a following stop character and is
+            // taken literally before anything else, like in tree_parse.
+            template <typename ...Stops>
+            bool read_escaped(char c, Stops ...stop)
+            {
+                bool is_stop = ((c == stop) || ...);
+                if (escape_pending)
+                {
+                    escape_pending = false;
+                    if (is_stop)
+                        return element.push_back(c), false;
+                    element.push_back('\\');
+                }
+                if (c == '\\')
+                    return escape_pending = true, false;
+                if (is_stop)
+                    return true;
+                element.push_back(c);
+                return false;
+            }
+            // Handles the character after an element, which has to be ',' while child slots are left and ']' after
+            // the last one.
+            void separate(char c)
+            {
+                if (pending.empty())
+                {
+                    if (c != ']')
+                        throw expect_failed("]");
+                    state = states::done;
+                }
+                else if (c != ',')
+                    throw expect_failed(",");
+                else
+                    state = states::element_start;
+            }
+            // Puts the element into the next child slot in preorder, or makes it the root.
+            void add_element(bool present)
+            {
+                if (tree.empty() && pending.empty())
+                {
+                    if (present)
+                    {
+                        tree.set_root(to_value());
+                        pending.push_back({tree.root(preorder, direction{}), false, false});
+                    }
+                    return;
+                }
+                auto &top = pending.back();
+                std::optional<iter_type> child;
+                if (!top.first_filled)
+                {
+                    top.first_filled = true;
+                    if (present)
+                        child = tree.new_child(top.iter, to_value(), direction{}, defer_update);
+                }
+                else
+                {
+                    top.second_filled = true;
+                    if (present)
+                        child = tree.new_child(top.iter, to_value(), typename direction::inverse{}, defer_update);
+                }
+                if (child)
+                    pending.push_back({*child, false, false});
+                else
+                    finish_subtrees();
+            }
+            // Pops the nodes whose child slots have all been read, as their subtrees are complete now.
+            void finish_subtrees()
+            {
+                while (!pending.empty() && pending.back().second_filled)
+                {
+                    auto iter = pending.back().iter;
+                    pending.pop_back();
+                    if (finished)
+                        finished(iter);
+                }
+            }
+            value_type to_value()
+            {
+                value_type result;
+                assign_element(std::string_view(element), result);
+                return result;
+            }
+
+            tree_type tree;
+            std::vector<pending_node> pending;
+            std::string element;
+            states state = states::open;
+            bool escape_pending = false;
+            std::function<void(iter_type)> finished;
+        };
+    }
+}
+
+#endif //INC_201703_PUSH_PARSE_HPP
@@ -1,60 +1,175 @@
 #ifndef INC_201703_SAVE_LOAD_HPP
 #define INC_201703_SAVE_LOAD_HPP
 
+#include <charconv>
+#include <cstring>
+#include <ostream>
+#include <sstream>
+#include <string_view>
+#include <type_traits>
+#include <vector>
 #include "tree_parse.hpp"
+#include "binary_format.hpp"
 
 namespace ds_exp
 {
     inline namespace tree
     {
-        template <typename T>
-        std::istream &operator>>(std::istream &in, ds_exp::binary_tree<T> &tree)
+        // Reads the text form, or the binary form of write_binary if it starts with the binary magic.
+        template <typename T, typename Allocator, typename Augment>
+        std::istream &operator>>(std::istream &in, ds_exp::binary_tree<T, Allocator, Augment> &tree)
         {
-            tree = ds_exp::tree_parse<ds_exp::left_first_t, T>(in).get_binary_tree().value();
+            if (binary_follows(in))
+                return read_binary(in, tree);
+            tree = ds_exp::tree_parse<ds_exp::left_first_t, T, Allocator, Augment>(in, tree.get_allocator()).get_binary_tree().value();
             return in;
         }
 
-        template <typename T, typename ...Escaped>
-        std::ostream &escape(std::ostream &out, T const &t, Escaped ...escaped)
+        namespace detail
         {
-            std::ostringstream stream;
-            stream << t;
-            auto output = stream.str();
-            for (auto iter = output.begin(); iter != output.end(); ++iter)
+            // Collects the output in a buffer of Size characters and hands it to the stream in writes of that size,
+            // when it is full and when the buffer goes away.
+            template <std::size_t Size>
+            class output_buffer
             {
-                if (((*iter == escaped) || ...))
+            public:
+                explicit output_buffer(std::ostream &out)
+                    : out(out)
                 {
-                    iter = output.insert(iter, '\\');
-                    ++iter;
                 }
-            }
-            return out << output;
+                output_buffer(output_buffer const &) = delete;
+                output_buffer &operator=(output_buffer const &) = delete;
+                ~output_buffer()
+                {
+                    flush();
+                }
 
+                void put(char c)
+                {
+                    if (used == Size)
+                        flush();
+                    data[used++] = c;
+                }
+                void append(std::string_view text)
+                {
+                    if (text.size() > Size - used)
+                    {
+                        flush();
+                        if (text.size() >= Size)
+                        {
+                            out.write(text.data(), std::streamsize(text.size()));
+                            return;
+                        }
+                    }
+                    std::memcpy(data + used, text.data(), text.size());
+                    used += text.size();
+                }
+                // Room for n characters at the end of the buffer, n being at most Size. commit takes the ones written.
+                char *reserve(std::size_t n)
+                {
+                    if (n > Size - used)
+                        flush();
+                    return data + used;
+                }
+                void commit(char *end)
+                {
+                    used = std::size_t(end - data);
+                }
+                void flush()
+                {
+                    if (used)
+                        out.write(data, std::streamsize(used));
+                    used = 0;
+                }
+
+            private:
+                std::ostream &out;
+                char data[Size];
+                std::size_t used = 0;
+            };
+            // Large enough for the shortest form of any number std::to_chars formats.
+            constexpr std::size_t max_number_chars = 64;
+        }
+
+        // Appends text, putting a backslash before every one of the escaped characters. The runs between them are
+        // copied as a whole.
+        template <typename Buffer, typename ...Escaped>
+        void put_escaped(Buffer &out, std::string_view text, Escaped ...escaped)
+        {
+            std::size_t run = 0;
+            for (std::size_t i = 0; i < text.size(); ++i)
+            {
+                if (((text[i] == escaped) || ...))
+                {
+                    out.append(text.substr(run, i - run));
+                    out.put('\\');
+                    run = i;
+                }
+            }
+            out.append(text.substr(run));
+        }
+        // Appends one element like operator<< prints it, escaped. Text is copied and numbers are formatted with
+        // std::to_chars, the counterpart of the std::from_chars the buffer parsers use, so neither allocates. Types
+        // made of parts overload put_element next to themselves.
+        template <typename Buffer, typename T, typename ...Escaped>
+        void put_element(Buffer &out, T const &t, Escaped ...escaped)
+        {
+            if constexpr (std::is_convertible_v<T const &, std::string_view>)
+                put_escaped(out, std::string_view(t), escaped...);
+            else if constexpr (parse::detail::parsed_by_from_chars<T>)
+            {
+                auto first = out.reserve(detail::max_number_chars);
+                out.commit(std::to_chars(first, first + detail::max_number_chars, t).ptr);
+            }
+            else
+            {
+                std::ostringstream stream;
+                stream << t;
+                put_escaped(out, stream.str(), escaped...);
+            }
+        }
+        template <typename T, typename ...Escaped>
+        std::ostream &escape(std::ostream &out, T const &t, Escaped ...escaped)
+        {
+            detail::output_buffer<256> buffer(out);
+            put_element(buffer, t, escaped...);
+            return out;
         }
         inline void print_null(std::ostream &out)
         {
             out << "null";
         }
-        template <typename Iter>
-        void print_node(std::ostream &out, Iter iter)
+        // Prints the subtree in preorder, keeping the child slots still to print on a heap allocated stack.
+        template <typename Buffer, typename Iter>
+        void print_node(Buffer &out, Iter iter)
         {
-            if (!iter)
+            std::vector<Iter> pending{iter};
+            while (!pending.empty())
             {
-                print_null(out);
-                return;
+                auto current = pending.back();
+                pending.pop_back();
+                if (!current)
+                    out.append("null");
+                else
+                {
+                    out.put('(');
+                    put_element(out, *current, ')');
+                    out.put(')');
+                    pending.push_back(current.second_child());
+                    pending.push_back(current.first_child());
+                }
+                if (!pending.empty())
+                    out.put(',');
             }
-            out << "(";
-            escape(out, *iter, ')') << ")";
-            print_node(out << ",", iter.first_child());
-            print_node(out << ",", iter.second_child());
-        }
-        template <typename T>
-        std::ostream &operator<<(std::ostream &out, binary_tree<T> const &tree)
-        {
-            out << "[";;
-            auto iter = tree.begin(preorder);
-            print_node(out, iter);
-            out << "]";
+        }
+        // The definition is collected in a 64 KiB buffer on the stack and written in blocks of that size.
+        template <typename T, typename Allocator, typename Augment>
+        std::ostream &operator<<(std::ostream &out, binary_tree<T, Allocator, Augment> const &tree)
+        {
+            detail::output_buffer<1 << 16> buffer(out);
+            buffer.put('[');
+            print_node(buffer, tree.begin(preorder));
+            buffer.put(']');
             return out;
         }
     }
@@ -0,0 +1,234 @@
+#ifndef INC_201703_STRING_POOL_HPP
+#define INC_201703_STRING_POOL_HPP
+
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
+#include "arena_allocator.hpp"
+
+namespace ds_exp
+{
+    inline namespace memory
+    {
+        // Keeps one copy of every distinct string in a node_arena. Interned strings stay where they are until the pool
+        // is destroyed, so handles to them are plain pointers. Interning is thread-safe.
+        class string_pool
+        {
+        public:
+            class scope;
+
+            string_pool() = default;
+            string_pool(string_pool const &) = delete;
+            string_pool &operator=(string_pool const &) = delete;
+
+            // The pool of the innermost scope open on the calling thread, which interned_string values made from text
+            // alone are stored in.
+            static string_pool &current()
+            {
+                auto pool = installed;
+                if (!pool)
+                    throw std::logic_error("interned_string used outside of a string_pool::scope");
+                return *pool;
+            }
+
+            // Returns the stored copy of s, null terminated and preceded by its length. The empty string is nullptr.
+            char const *intern(std::string_view s)
+            {
+                if (s.empty())
+                    return nullptr;
+                std::lock_guard<std::mutex> lock(mutex);
+                if (auto found = strings.find(s); found != strings.end())
+                    return found->data();
+                auto header = static_cast<std::size_t *>(arena.allocate(sizeof(std::size_t) + s.size() + 1, alignof(std::size_t)));
+                *header = s.size();
+                auto chars = reinterpret_cast<char *>(header + 1);
+                std::memcpy(chars, s.data(), s.size());
+                chars[s.size()] = '\0';
+                strings.emplace(chars, s.size());
+                return chars;
+            }
+            std::size_t size() const
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                return strings.size();
+            }
+
+        private:
+            inline static thread_local string_pool *installed = nullptr;
+
+            node_arena arena;
+            std::unordered_set<std::string_view> strings;
+            mutable std::mutex mutex;
+        };
+
+        // Makes a pool the current one of the calling thread until the scope closes. Scopes are local variables, so
+        // they nest. Open one around each piece of work that parses interned strings, on the thread that runs it.
+        class string_pool::scope
+        {
+        public:
+            explicit scope(string_pool &pool)
+                : previous(std::exchange(installed, &pool))
+            {
+            }
+            scope(scope const &) = delete;
+            scope &operator=(scope const &) = delete;
+            ~scope()
+            {
+                installed = previous;
+            }
+
+        private:
+            string_pool *previous;
+        };
+
+        class interned_string;
+        namespace detail
+        {
+            template <typename S>
+            using if_text = std::enable_if_t<std::is_convertible_v<S const &, std::string_view> && !std::is_same_v<S, interned_string>>;
+        }
+
+        // Immutable string stored in a string_pool, the given one or string_pool::current(). It is a single pointer,
+        // and equal strings of one pool share the pointer, so comparing two of them for equality doesn't look at the
+        // characters. Ordering and hashing still use the characters, so hashes don't depend on where the pool put
+        // them. Comparisons with other strings go through std::string_view.
+        class interned_string
+        {
+        public:
+            interned_string() = default;
+            explicit interned_string(std::string_view s)
+                : interned_string(s, string_pool::current())
+            {
+            }
+            interned_string(std::string_view s, string_pool &pool)
+                : chars(pool.intern(s))
+            {
+            }
+            explicit interned_string(std::string const &s)
+                : interned_string(std::string_view(s))
+            {
+            }
+            explicit interned_string(char const *s)
+                : interned_string(std::string_view(s))
+            {
+            }
+
+            std::size_t size() const
+            {
+                return chars ? reinterpret_cast<std::size_t const *>(chars)[-1] : 0;
+            }
+            bool empty() const
+            {
+                return !chars;
+            }
+            char const *c_str() const
+            {
+                return chars ? chars : "";
+            }
+            std::string_view view() const
+            {
+                return std::string_view(c_str(), size());
+            }
+            operator std::string_view() const
+            {
+                return view();
+            }
+            std::string str() const
+            {
+                return std::string(view());
+            }
+
+            friend bool operator==(interned_string lhs, interned_string rhs)
+            {
+                return lhs.chars == rhs.chars;
+            }
+            friend bool operator!=(interned_string lhs, interned_string rhs)
+            {
+                return lhs.chars != rhs.chars;
+            }
+            friend bool operator<(interned_string lhs, interned_string rhs)
+            {
+                return lhs.chars != rhs.chars && lhs.view() < rhs.view();
+            }
+            friend bool operator>(interned_string lhs, interned_string rhs)
+            {
+                return rhs < lhs;
+            }
+            friend bool operator<=(interned_string lhs, interned_string rhs)
+            {
+                return !(rhs < lhs);
+            }
+            friend bool operator>=(interned_string lhs, interned_string rhs)
+            {
+                return !(lhs < rhs);
+            }
+            // Templates, so that they are preferred over generic comparisons like the ones of tree_adapter.
+            template <typename S, typename = detail::if_text<S>>
+            friend bool operator==(interned_string const &lhs, S const &rhs)
+            {
+                return lhs.view() == std::string_view(rhs);
+            }
+            template <typename S, typename = detail::if_text<S>>
+            friend bool operator==(S const &lhs, interned_string const &rhs)
+            {
+                return std::string_view(lhs) == rhs.view();
+            }
+            template <typename S, typename = detail::if_text<S>>
+            friend bool operator!=(interned_string const &lhs, S const &rhs)
+            {
+                return lhs.view() != std::string_view(rhs);
+            }
+            template <typename S, typename = detail::if_text<S>>
+            friend bool operator!=(S const &lhs, interned_string const &rhs)
+            {
+                return std::string_view(lhs) != rhs.view();
+            }
+            template <typename S, typename = detail::if_text<S>>
+            friend bool operator<(interned_string const &lhs, S const &rhs)
+            {
+                return lhs.view() < std::string_view(rhs);
+            }
+            template <typename S, typename = detail::if_text<S>>
+            friend bool operator<(S const &lhs, interned_string const &rhs)
+            {
+                return std::string_view(lhs) < rhs.view();
+            }
+            friend std::ostream &operator<<(std::ostream &out, interned_string s)
+            {
+                return out << s.view();
+            }
+
+        private:
+            char const *chars = nullptr;
+        };
+
+        // Parsing and console input intern the text as a whole, like they take std::string as a whole.
+        inline void assign_element(std::string_view str, interned_string &v)
+        {
+            v = interned_string(str);
+        }
+        inline void assign_element(std::string str, interned_string &v)
+        {
+            v = interned_string(str);
+        }
+    }
+}
+
+template <>
+struct std::hash<ds_exp::interned_string>
+{
+    std::size_t operator()(ds_exp::interned_string s) const noexcept
+    {
+        return std::hash<std::string_view>{}(s.view());
+    }
+};
+
+#endif //INC_201703_STRING_POOL_HPP
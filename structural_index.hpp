@@ -0,0 +1,217 @@
+#ifndef INC_201703_STRUCTURAL_INDEX_HPP
+#define INC_201703_STRUCTURAL_INDEX_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include "tree_parse.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DS_EXP_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace ds_exp
+{
+    inline namespace parse
+    {
+        // Implementations of the first pass, from the slowest to the fastest.
+        enum class index_kernel
+        {
+            scalar,
+            sse2,
+            avx2
+        };
+
+        namespace detail
+        {
+            // Every 64 byte block of the text is turned into two bitmaps: the characters an element can end at
+            // (',', ']' and ')') and the backslashes. The brackets and parens opening a definition or an element
+            // are always the next non-space character, so the parser finds them without the index.
+            struct block_masks
+            {
+                std::uint64_t structural;
+                std::uint64_t backslash;
+            };
+            constexpr std::size_t block_size = 64;
+
+            inline block_masks classify_scalar(char const *block)
+            {
+                block_masks masks{0, 0};
+                for (std::size_t i = 0; i < block_size; ++i)
+                {
+                    auto c = block[i];
+                    if (c == ',' || c == ']' || c == ')')
+                        masks.structural |= std::uint64_t(1) << i;
+                    else if (c == '\\')
+                        masks.backslash |= std::uint64_t(1) << i;
+                }
+                return masks;
+            }
+#ifdef DS_EXP_X86_KERNELS
+            __attribute__((target("sse2"))) inline block_masks classify_sse2(char const *block)
+            {
+                block_masks masks{0, 0};
+                for (std::size_t i = 0; i < block_size; i += 16)
+                {
+                    auto chars = _mm_loadu_si128(reinterpret_cast<__m128i const *>(block + i));
+                    auto structural = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8(',')), _mm_cmpeq_epi8(chars, _mm_set1_epi8(']'))),
+                                                   _mm_cmpeq_epi8(chars, _mm_set1_epi8(')')));
+                    auto backslash = _mm_cmpeq_epi8(chars, _mm_set1_epi8('\\'));
+                    masks.structural |= std::uint64_t(std::uint16_t(_mm_movemask_epi8(structural))) << i;
+                    masks.backslash |= std::uint64_t(std::uint16_t(_mm_movemask_epi8(backslash))) << i;
+                }
+                return masks;
+            }
+            __attribute__((target("avx2"))) inline block_masks classify_avx2(char const *block)
+            {
+                block_masks masks{0, 0};
+                for (std::size_t i = 0; i < block_size; i += 32)
+                {
+                    auto chars = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(block + i));
+                    auto structural = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(chars, _mm256_set1_epi8(',')),
+                                                                      _mm256_cmpeq_epi8(chars, _mm256_set1_epi8(']'))),
+                                                      _mm256_cmpeq_epi8(chars, _mm256_set1_epi8(')')));
+                    auto backslash = _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('\\'));
+                    masks.structural |= std::uint64_t(std::uint32_t(_mm256_movemask_epi8(structural))) << i;
+                    masks.backslash |= std::uint64_t(std::uint32_t(_mm256_movemask_epi8(backslash))) << i;
+                }
+                return masks;
+            }
+#endif
+
+            inline int lowest_bit(std::uint64_t bits)
+            {
+#ifdef __GNUC__
+                return __builtin_ctzll(bits);
+#else
+                int i = 0;
+                while (!(bits & 1))
+                    bits >>= 1, ++i;
+                return i;
+#endif
+            }
+
+            using classifier = block_masks (*)(char const *);
+        }
+
+        // The fastest kernel the processor supports, checked once through CPUID.
+        inline index_kernel best_index_kernel()
+        {
+#ifdef DS_EXP_X86_KERNELS
+            static index_kernel const best = [] {
+                __builtin_cpu_init();
+                if (__builtin_cpu_supports("avx2"))
+                    return index_kernel::avx2;
+                if (__builtin_cpu_supports("sse2"))
+                    return index_kernel::sse2;
+                return index_kernel::scalar;
+            }();
+            return best;
+#else
+            return index_kernel::scalar;
+#endif
+        }
+
+        namespace detail
+        {
+            // Kernels the processor doesn't support are replaced by the scalar one.
+            inline classifier classifier_of(index_kernel kernel)
+            {
+                if (kernel > best_index_kernel())
+                    kernel = index_kernel::scalar;
+                switch (kernel)
+                {
+#ifdef DS_EXP_X86_KERNELS
+                    case index_kernel::avx2:
+                        return classify_avx2;
+                    case index_kernel::sse2:
+                        return classify_sse2;
+#endif
+                    default:
+                        return classify_scalar;
+                }
+            }
+
+            // buffer_reader that finds the end of an element in the structural bitmaps instead of comparing every
+            // character. The blocks are classified one after another as the reading advances, so only the bitmap of
+            // the current block is kept. Elements containing a backslash are unescaped by buffer_reader.
+            class indexed_reader : public buffer_reader
+            {
+            public:
+                explicit indexed_reader(std::string_view text, index_kernel kernel = best_index_kernel())
+                    : buffer_reader(text), classify(classifier_of(kernel))
+                {
+                }
+                template <typename ...Stops>
+                std::string_view read_until(bool skip_backslash, Stops ...stop)
+                {
+                    if (skip_backslash)
+                        return buffer_reader::read_until(skip_backslash, stop...);
+                    auto stop_pos = find_structural(stop...);
+                    auto element = text.substr(pos, stop_pos - pos);
+                    if (element.find('\\') != std::string_view::npos)
+                        return buffer_reader::read_until(false, stop...);
+                    pos = stop_pos;
+                    return element;
+                }
+
+            private:
+                // Position of the first unescaped stop at or after pos, or the size of the text.
+                template <typename ...Stops>
+                std::size_t find_structural(Stops ...stop)
+                {
+                    for (auto from = pos;; from = next_block)
+                    {
+                        while (next_block <= from)
+                            next_block_masks();
+                        auto base = next_block - block_size;
+                        auto bits = structural;
+                        if (from > base)
+                            bits &= ~std::uint64_t(0) << (from - base);
+                        for (; bits; bits &= bits - 1)
+                        {
+                            auto found = base + std::size_t(lowest_bit(bits));
+                            if (((text[found] == stop) || ...))
+                                return found;
+                        }
+                        if (next_block >= text.size())
+                            return text.size();
+                    }
+                }
+                void next_block_masks()
+                {
+                    char tail[block_size];
+                    auto block = text.data() + next_block;
+                    if (text.size() - std::min(text.size(), next_block) < block_size)
+                    {
+                        std::memset(tail, ' ', block_size);
+                        if (next_block < text.size())
+                            std::memcpy(tail, block, text.size() - next_block);
+                        block = tail;
+                    }
+                    auto masks = classify(block);
+                    // A character right after a backslash is escaped. Backslashes themselves are never escaped
+                    // outside of the elements, so runs of them need no special care.
+                    auto escaped = masks.backslash << 1 | carry;
+                    carry = masks.backslash >> 63;
+                    structural = masks.structural & ~escaped;
+                    next_block += block_size;
+                }
+
+                classifier classify;
+                std::size_t next_block = 0;
+                std::uint64_t structural = 0;
+                std::uint64_t carry = 0;
+            };
+        }
+
+        // Parses a definition held in memory, locating the ends of the elements with SIMD classification of the
+        // text in 64 byte blocks. A scalar kernel is used on processors without SSE2 or AVX2.
+        template <typename direction, typename T, typename Allocator = std::allocator<T>, typename Augment = no_augment>
+        using indexed_parse = basic_tree_parse<detail::indexed_reader, direction, T, Allocator, Augment>;
+    }
+}
+
+#endif //INC_201703_STRUCTURAL_INDEX_HPP
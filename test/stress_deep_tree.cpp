@@ -0,0 +1,11 @@
+#include <cstdlib>
+#include <iostream>
+#include "test_deep_tree.hpp"
+
+int main(int argc, char **argv)
+{
+    std::size_t depth = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10000000;
+    test_deep_tree(depth);
+    std::cout << "deep tree of " << depth << " levels: OK\n";
+    return 0;
+}
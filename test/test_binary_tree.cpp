@@ -1,6 +1,47 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <vector>
 #include "test_binary_tree.hpp"
 #include "../binary_tree.hpp"
+#include "../arena_allocator.hpp"
+#include "../compact_tree.hpp"
+#include "../frozen_tree.hpp"
+#include "../mapped_tree.hpp"
+#include "../tree_parallel.hpp"
+#include "../ordered_tree.hpp"
+#include "../persistent_tree.hpp"
+
+namespace
+{
+    // Irregular shape: some levels have gaps, and the deepest level isn't below the first node.
+    template <typename Augment>
+    ds_exp::binary_tree<int, std::allocator<int>, Augment> irregular_tree(int n)
+    {
+        using namespace ds_exp;
+        binary_tree<int, std::allocator<int>, Augment> tree;
+        tree.set_root(0);
+        std::vector<decltype(tree.root())> nodes{tree.root()};
+        for (int i = 1; i < n; ++i)
+        {
+            auto parent = nodes[std::size_t(i) * 2654435761u % nodes.size()];
+            while (parent.first_child() && parent.second_child())
+                parent = parent.first_child();
+            if (parent.first_child())
+                nodes.push_back(tree.new_child(parent, i, right_child));
+            else
+                nodes.push_back(tree.new_child(parent, i, left_child));
+        }
+        return tree;
+    }
+}
 
 void test_binary_tree()
 {
@@ -65,8 +106,559 @@ void test_binary_tree()
         assert(--postorder_iter == left_right);
         assert(--postorder_iter == left_left);
     }
+    {
+        auto levelorder_iter = tree.begin(levelorder);
+        assert(levelorder_iter == root);
+        assert(++levelorder_iter == left);
+        assert(++levelorder_iter == right);
+        assert(++levelorder_iter == left_left);
+        assert(++levelorder_iter == left_right);
+        assert(++levelorder_iter == tree.end());
+        assert(--levelorder_iter == left_right);
+        assert(--levelorder_iter == left_left);
+        assert(--levelorder_iter == right);
+        assert(--levelorder_iter == left);
+        assert(--levelorder_iter == root);
+        assert(std::find(tree.begin(levelorder), tree.end(levelorder), "left right") == left_right);
+        auto expected = tree.begin(levelorder, right_first);
+        for (auto &element : level_order(tree, right_first))
+            assert(element == *expected++);
+        assert(expected == tree.end(levelorder, right_first));
+    }
+    {
+        auto irregular = irregular_tree<height_augment>(500);
+        std::vector<int> queued;
+        for (int value : level_order(irregular))
+            queued.push_back(value);
+        assert(queued.size() == 500);
+        assert(std::equal(queued.begin(), queued.end(), irregular.begin(levelorder), irregular.end(levelorder)));
+        assert(std::equal(queued.rbegin(), queued.rend(), std::make_reverse_iterator(irregular.end(levelorder)),
+                          std::make_reverse_iterator(irregular.begin(levelorder))));
+        binary_tree<int> plain(irregular);
+        assert(*--plain.end(levelorder) == queued.back());
+        compact_tree<int> compact(plain), compact_augmented(irregular);
+        assert(compact_augmented == compact);
+        std::vector<int> right_first_values;
+        for (int value : tree_iterate(compact, levelorder, right_first))
+            right_first_values.push_back(value);
+        assert(std::equal(right_first_values.begin(), right_first_values.end(), plain.begin(levelorder, right_first)));
+    }
+    {
+        auto shaped = irregular_tree<no_augment>(500);
+        auto check_morris = [&shaped](auto order, auto dir) {
+            std::vector<int> visited;
+            morris_for_each(shaped, [&visited](int value) { visited.push_back(value); }, order, dir);
+            assert(std::equal(visited.begin(), visited.end(), shaped.begin(order, dir), shaped.end(order, dir)));
+            assert(visited.size() == shaped.size());
+        };
+        auto copy = shaped;
+        check_morris(inorder, left_first);
+        check_morris(inorder, right_first);
+        check_morris(preorder, left_first);
+        check_morris(preorder, right_first);
+        // The links threaded so far are restored even when the traversal stops early.
+        int visits = 0;
+        try
+        {
+            morris_for_each(shaped, [&visits](int) {
+                if (++visits == 100)
+                    throw std::runtime_error("stop");
+            }, inorder);
+        }
+        catch (std::runtime_error const &)
+        {
+        }
+        assert(visits == 100 && shaped == copy);
+        assert(std::equal(shaped.begin(postorder), shaped.end(postorder), copy.begin(postorder), copy.end(postorder)));
+    }
+    {
+        std::vector<int> sorted(1000);
+        for (int i = 0; i < 1000; ++i)
+            sorted[std::size_t(i)] = i * 3;
+        auto balanced = binary_tree<int, std::allocator<int>, augments<height_augment, size_augment>>::from_sorted(sorted.begin(), sorted.end());
+        assert(balanced.size() == 1000 && balanced.depth() == 10);
+        assert(std::equal(sorted.begin(), sorted.end(), balanced.begin(inorder), balanced.end(inorder)));
+        assert(*balanced.nth(500, inorder) == 1500);
+        auto arena_balanced = binary_tree<int, arena_allocator<int>, inorder_threads>::from_sorted(sorted.begin(), sorted.end());
+        assert(std::equal(sorted.rbegin(), sorted.rend(), arena_balanced.begin(inorder, right_first), arena_balanced.end(inorder, right_first)));
+        assert(binary_tree<int>::from_sorted(sorted.begin(), sorted.begin()).empty());
+
+        auto shaped = irregular_tree<no_augment>(500);
+        std::vector<int> pre(shaped.begin(preorder), shaped.end(preorder));
+        std::vector<int> in(shaped.begin(inorder), shaped.end(inorder));
+        std::vector<int> post(shaped.begin(postorder), shaped.end(postorder));
+        auto from_pre = binary_tree<int>::from_preorder_inorder(pre.begin(), pre.end(), in.begin(), in.end());
+        assert(from_pre == shaped);
+        auto from_post = binary_tree<int, std::allocator<int>, inorder_threads>::from_postorder_inorder(post.begin(), post.end(), in.begin(), in.end());
+        assert(binary_tree<int>(from_post) == shaped);
+        assert(std::equal(in.begin(), in.end(), from_post.begin(inorder), from_post.end(inorder)));
+        auto rejects = [&pre](std::vector<int> const &wrong) {
+            try
+            {
+                binary_tree<int>::from_preorder_inorder(pre.begin(), pre.end(), wrong.begin(), wrong.end());
+            }
+            catch (std::invalid_argument const &)
+            {
+                return true;
+            }
+            return false;
+        };
+        auto unknown = in;
+        unknown[250] = -1;
+        assert(rejects(unknown) && rejects(std::vector<int>(in.begin(), in.end() - 1)));
+        std::vector<int> chain_pre{1, 2, 3}, chain_in{3, 2, 1};
+        auto chain = binary_tree<int>::from_preorder_inorder(chain_pre.begin(), chain_pre.end(), chain_in.begin(), chain_in.end());
+        assert(chain.depth() == 3 && *chain.root().first_child().first_child() == 3);
+    }
     {
         auto tree2 = tree;
         assert(tree2 == tree);
     }
+    {
+        binary_tree<std::string, arena_allocator<std::string>> arena_tree;
+        arena_tree.set_root("root");
+        auto arena_root = arena_tree.root();
+        arena_tree.new_child(arena_tree.new_child(arena_root, "left child", left_child), "left left", left_child);
+        arena_tree.new_child(arena_root, "right child", right_child);
+        auto arena_copy = arena_tree;
+        assert(arena_copy == arena_tree);
+        assert(arena_copy.get_allocator() != arena_tree.get_allocator());
+        auto removed = arena_tree.remove(arena_tree.root().first_child());
+        assert(removed.get_allocator() == arena_tree.get_allocator());
+        assert(*removed.root() == "left child");
+        assert(*++arena_tree.begin() == "right child");
+        arena_copy.clear();
+        assert(arena_copy.empty());
+        arena_copy.set_root("new root");
+        assert(*arena_copy.root() == "new root");
+        // Subtrees from another arena are copied in, the moved-from tree can still grow.
+        arena_copy.replace_child(arena_copy.root(), std::move(removed), right_child);
+        assert(*arena_copy.root().second_child().first_child() == "left left");
+        auto moved = std::move(arena_copy);
+        arena_copy.set_root("after move");
+        arena_copy.new_child(arena_copy.root(), "child", left_child);
+        assert(*arena_copy.root().first_child() == "child" && moved.depth() == 3);
+        arena_copy.replace(arena_copy.root(), std::move(moved));
+        assert(*arena_copy.root() == "new root");
+    }
+    {
+        binary_tree<std::string, std::allocator<std::string>, height_augment> heights;
+        heights.set_root("root");
+        assert(heights.depth() == 1);
+        auto heights_left = heights.new_child(heights.root(), "left child", left_child);
+        auto heights_right = heights.new_child(heights.root(), "right child", right_child);
+        auto heights_left_left = heights.new_child(heights_left, "left left", left_child);
+        heights.new_child(heights_left_left, "left left left", right_child);
+        assert(heights.depth() == 4);
+        assert(heights.subtree_depth(heights_left) == 3);
+        assert(heights.subtree_depth(heights_right) == 1);
+        auto heights_copy = heights;
+        assert(heights_copy.depth() == 4);
+        auto removed = heights.remove(heights_left_left);
+        assert(removed.depth() == 2);
+        assert(heights.depth() == 2);
+        heights.replace_child(heights_right, std::move(removed), right_child);
+        assert(heights.depth() == 4);
+        assert(heights.subtree_depth(heights_left) == 1);
+        heights.clear();
+        assert(heights.depth() == 0);
+    }
+    {
+        binary_tree<std::string, std::allocator<std::string>, inorder_threads> threaded(tree);
+        auto check_inorder = [&threaded](std::vector<std::string> const &expected) {
+            auto iter = threaded.begin(inorder);
+            for (auto &element : expected)
+                assert(*iter++ == element);
+            assert(iter == threaded.end(inorder));
+            for (auto element = expected.rbegin(); element != expected.rend(); ++element)
+                assert(*--iter == *element);
+            auto reverse_iter = threaded.begin(inorder, right_first);
+            for (auto element = expected.rbegin(); element != expected.rend(); ++element)
+                assert(*reverse_iter++ == *element);
+            assert(reverse_iter == threaded.end(inorder, right_first));
+        };
+        check_inorder({"left left", "left child", "left right", "root", "right child"});
+        auto threaded_left = threaded.root().first_child();
+        auto removed = threaded.remove(threaded_left);
+        check_inorder({"root", "right child"});
+        threaded.replace_child(threaded.root().second_child(), std::move(removed), left_child);
+        check_inorder({"root", "left left", "left child", "left right", "right child"});
+        threaded.new_child(threaded.root().second_child().first_child(), "new left", left_child);
+        check_inorder({"root", "new left", "left child", "left right", "right child"});
+        threaded.new_child(threaded.root(), "new root left", left_child);
+        check_inorder({"new root left", "root", "new left", "left child", "left right", "right child"});
+        auto threaded_copy = threaded;
+        threaded.clear();
+        std::swap(threaded, threaded_copy);
+        check_inorder({"new root left", "root", "new left", "left child", "left right", "right child"});
+    }
+    {
+        binary_tree<std::string, std::allocator<std::string>, size_augment> sized(tree);
+        static_assert(std::is_same_v<decltype(sized.begin())::iterator_category, std::random_access_iterator_tag>);
+        static_assert(std::is_same_v<decltype(tree.begin())::iterator_category, std::bidirectional_iterator_tag>);
+        assert(sized.size() == 5 && tree.size() == 5);
+        auto check_positions = [&sized](auto order, auto dir) {
+            auto first = sized.begin(order, dir);
+            std::size_t k = 0;
+            for (auto iter = first; iter != sized.end(order, dir); ++iter, ++k)
+            {
+                assert(sized.nth(k, order, dir) == iter);
+                assert(sized.rank(iter) == k);
+                assert(iter - first == std::ptrdiff_t(k));
+                assert(first + k == iter && first[k] == *iter);
+            }
+            assert(sized.nth(k, order, dir) == sized.end(order, dir));
+            assert(sized.end(order, dir) - first == std::ptrdiff_t(k));
+            assert(sized.end(order, dir) - std::ptrdiff_t(k) == first);
+        };
+        check_positions(preorder, left_first);
+        check_positions(inorder, left_first);
+        check_positions(postorder, left_first);
+        check_positions(preorder, right_first);
+        check_positions(inorder, right_first);
+        check_positions(postorder, right_first);
+        auto iter = sized.begin(inorder);
+        iter += 3;
+        assert(*iter == "root" && iter[-3] == "left left" && *(iter - 1) == "left right");
+        assert(sized.begin(inorder) < iter && iter <= sized.end(inorder) && !(iter > sized.end(inorder)));
+        assert(std::distance(iter, sized.end(inorder)) == 2);
+        auto removed = sized.remove(sized.root().first_child());
+        assert(sized.size() == 2 && removed.size() == 3);
+        assert(*sized.nth(1, postorder) == "root");
+        sized.replace_child(sized.root().second_child(), std::move(removed), right_child);
+        sized.new_child(sized.nth(0, inorder), "first", left_child);
+        assert(sized.size() == 6);
+        assert(*sized.nth(5, inorder) == "left right");
+        check_positions(inorder, left_first);
+        check_positions(postorder, right_first);
+    }
+    {
+        // Rotations and node erasure have to keep every augmentation and the threads right.
+        binary_tree<int, std::allocator<int>, augments<height_augment, size_augment, inorder_threads>> avl;
+        std::vector<bool> present(2003);
+        for (int i = 0; i < 2000; ++i)
+        {
+            auto value = i * 7919 % 2003;
+            auto [iter, inserted] = avl_insert(avl, value);
+            assert(inserted && *iter == value);
+            present[value] = true;
+        }
+        assert(!avl_insert(avl, 5).second);
+        for (int value = 0; value < 2003; value += 3)
+        {
+            if (auto found = bst_find(avl, value))
+            {
+                auto next = avl_erase(avl, found);
+                assert(next == bst_upper_bound(avl, value));
+                present[value] = false;
+            }
+        }
+        std::vector<int> expected;
+        for (int value = 0; value < 2003; ++value)
+            if (present[value])
+                expected.push_back(value);
+        assert(avl.size() == expected.size());
+        auto avl_iter = avl.begin(inorder);
+        for (std::size_t i = 0; i < expected.size(); ++i, ++avl_iter)
+            assert(*avl_iter == expected[i] && avl.nth(i, inorder) == avl_iter);
+        assert(avl_iter == avl.end(inorder));
+        for (auto value = expected.rbegin(); value != expected.rend(); ++value)
+            assert(*--avl_iter == *value);
+        for (auto iter = avl.begin(); iter != avl.end(); ++iter)
+        {
+            auto left_depth = avl.subtree_depth(iter.first_child(left_child));
+            auto right_depth = avl.subtree_depth(iter.first_child(right_child));
+            assert(left_depth <= right_depth + 1 && right_depth <= left_depth + 1);
+        }
+        assert(avl.depth() <= 15);
+        assert(*bst_lower_bound(avl, 3) == 4 && *bst_upper_bound(avl, 4) == 5);
+        assert(!bst_find(avl, 3) && bst_lower_bound(avl, 2003) == avl.end(inorder));
+    }
+    {
+        using hashed_tree = binary_tree<std::string, std::allocator<std::string>, hash_augment<>>;
+        hashed_tree hashed(tree);
+        assert(hashed.hash() != 0 && hashed == hashed_tree(tree));
+        auto saved = hashed.hash();
+        assert(!hashed.changed_since(saved));
+        auto leaf = hashed.root().first_child().first_child();
+        *leaf = "changed";
+        hashed.value_changed(leaf);
+        assert(hashed.changed_since(saved) && !(hashed == hashed_tree(tree)));
+        *leaf = "left left";
+        hashed.value_changed(leaf);
+        assert(hashed.hash() == saved);
+        // Same preorder values in another shape.
+        hashed_tree chain, mirrored;
+        chain.set_root("a");
+        chain.new_child(chain.root(), "b", left_child);
+        mirrored.set_root("a");
+        mirrored.new_child(mirrored.root(), "b", right_child);
+        assert(chain.hash() != mirrored.hash() && !(chain == mirrored));
+        binary_tree<std::string> plain_chain(chain), plain_mirrored(mirrored);
+        assert(!(plain_chain == plain_mirrored));
+        chain.rotate(chain.root().first_child());
+        assert(chain.hash() != mirrored.hash());
+        chain.rotate(chain.root().second_child());
+        assert(chain == hashed_tree(plain_chain));
+        assert(hashed_tree().hash() == 0);
+    }
+    {
+        persistent_tree<std::string> original(tree);
+        assert(original.size() == tree.size() && original.depth() == tree.depth());
+        assert(original.to_binary_tree() == tree);
+        auto check_order = [&](auto order, auto dir) {
+            auto expected = tree.begin(order, dir);
+            for (auto &element : tree_iterate(original, order, dir))
+                assert(element == *expected++);
+            assert(expected == tree.end(order, dir));
+        };
+        check_order(preorder, right_first);
+        check_order(inorder, left_first);
+        check_order(postorder, right_first);
+        check_order(postorder, left_first);
+        auto snapshot = original;
+        assert(snapshot.shares_root_with(original) && snapshot == original);
+        auto changed = original.assign(original.root().first_child().first_child(), "changed");
+        assert(*changed == "changed" && *changed.parent().parent() == "root");
+        assert(!snapshot.shares_root_with(original) && snapshot != original);
+        assert(*snapshot.root().first_child().first_child() == "left left");
+        // Only the path to the changed node was copied.
+        assert(&*snapshot.root().second_child() == &*original.root().second_child());
+        auto branch = original.subtree(original.root().first_child());
+        auto grown = original.new_child(original.root().second_child(), "grown", left_child);
+        assert(*grown.parent() == "right child" && original.size() == snapshot.size() + 1);
+        auto removed = original.remove_child(original.root(), left_child);
+        assert(removed == branch && original.size() == 3);
+        original.replace_child(original.root(), snapshot.subtree(snapshot.root().first_child()), left_child);
+        assert(original.size() == snapshot.size() + 1 && snapshot.size() == tree.size());
+        original.clear();
+        assert(original.empty() && original.begin(inorder) == original.end(inorder));
+    }
+    {
+        thread_pool::shared().resize(3);
+        binary_tree<int, std::allocator<int>, height_augment> large;
+        large.set_root(0);
+        std::vector<decltype(large.root())> level{large.root()};
+        for (std::size_t i = 0; level.size() < 20000; ++i)
+        {
+            level.push_back(large.new_child(level[i], int(level.size()), left_child));
+            if (i % 7)
+                level.push_back(large.new_child(level[i], int(level.size()), right_child));
+        }
+        auto large_copy = large;
+        assert(large_copy == large);
+        assert(large_copy.depth() == large.depth());
+        large_copy.remove(large_copy.root().first_child());
+        assert(large_copy.depth() == large.subtree_depth(large.root().second_child()) + 1);
+        large_copy = large;
+        assert(large_copy == large);
+
+        parallel_for_each(large, [](int &value) { value *= 2; });
+        auto expected = large_copy.begin();
+        for (auto value : tree_iterate(large, preorder))
+            assert(value == 2 * *expected++);
+        std::atomic<long long> sum{0};
+        parallel_for_each(large, [&sum](int value) { sum += value; });
+        assert(sum == 2LL * 20000 * 19999 / 2);
+        bool thrown = false;
+        try
+        {
+            parallel_for_each(large, [](int value) {
+                if (value == 30000)
+                    throw std::runtime_error("visitor failed");
+            });
+        }
+        catch (std::runtime_error const &)
+        {
+            thrown = true;
+        }
+        assert(thrown);
+
+        // Polynomial hash: associative but not commutative, so it only matches if the order is kept.
+        using hash_type = std::pair<unsigned long long, unsigned long long>;
+        auto combine = [](hash_type lhs, hash_type rhs) { return hash_type(lhs.first * rhs.second + rhs.first, lhs.second * rhs.second); };
+        auto single = [](int value) { return hash_type(static_cast<unsigned long long>(value), 1000003); };
+        auto check_reduce = [&](auto &reduced, auto order, auto dir) {
+            hash_type sequential(0, 1);
+            for (auto value : tree_iterate(reduced, order, dir))
+                sequential = combine(sequential, single(value));
+            assert(parallel_reduce(reduced, hash_type(0, 1), combine, single, order, dir) == sequential);
+        };
+        check_reduce(large, preorder, left_first);
+        check_reduce(large, inorder, left_first);
+        check_reduce(large, postorder, right_first);
+        binary_tree<int, std::allocator<int>, augments<height_augment, size_augment>> sized_large(large);
+        assert(sized_large.size() == 20000 && sized_large.depth() == large.depth());
+        check_reduce(sized_large, inorder, right_first);
+        check_reduce(sized_large, postorder, left_first);
+
+        std::mutex visited_mutex;
+        std::vector<int> visited;
+        parallel_level_order(large, [&](int value) {
+            std::lock_guard<std::mutex> lock(visited_mutex);
+            visited.push_back(value);
+        });
+        assert(visited.size() == 20000);
+        std::vector<std::size_t> depth_of(level.size());
+        for (std::size_t i = 1; i < level.size(); ++i)
+            depth_of[i] = depth_of[*level[i].parent() / 2] + 1;
+        for (std::size_t i = 1; i < visited.size(); ++i)
+            assert(depth_of[visited[i - 1] / 2] <= depth_of[visited[i] / 2]);
+        large.clear();
+        thread_pool::shared().resize(thread_pool::default_workers());
+    }
+    {
+        static_assert(sizeof(compact_node<std::string>) < sizeof(node<std::string>));
+        compact_tree<std::string> compact(tree);
+        assert(compact.size() == 5);
+        auto tree_iter = tree.begin(inorder);
+        for (auto &element : tree_iterate(compact, inorder))
+            assert(element == *tree_iter++);
+        assert(tree_iter == tree.end());
+        auto compact_iter = compact.end(postorder, right_first);
+        for (auto iter = tree.end(postorder, right_first); iter != tree.begin(postorder, right_first);)
+            assert(*--iter == *--compact_iter);
+        assert(compact_iter == compact.begin(postorder, right_first));
+        auto compact_root = compact.root();
+        assert(*compact_root.first_child().second_child() == "left right");
+        assert(compact_root.second_child().parent() == compact_root);
+        auto copied = compact;
+        assert(copied == compact);
+        compact_tree<std::string> leaning_left, leaning_right;
+        leaning_left.set_root("root");
+        leaning_left.new_child(leaning_left.root(), "child", left_child);
+        leaning_right.set_root("root");
+        leaning_right.new_child(leaning_right.root(), "child", right_child);
+        assert(!(leaning_left == leaning_right));
+        compact_tree<std::string> grown;
+        grown.set_root("root");
+        auto grown_right = grown.new_child(grown.root(), "right child", right_child);
+        for (auto i = 0; i < 100; ++i)
+            grown_right = grown.new_child(grown_right, std::to_string(i), left_child);
+        assert(*grown.begin(inorder) == "root");
+        assert(*++grown.begin(inorder) == "99");
+        assert(*--grown.end(inorder) == "right child");
+        assert(*grown.begin(postorder).parent().parent() == "97");
+    }
+    {
+        auto check_orders = [&tree](frozen_tree<std::string> const &frozen) {
+            assert(frozen.size() == 5);
+            auto tree_iter = tree.begin(inorder);
+            for (auto &element : tree_iterate(frozen, inorder))
+                assert(element == *tree_iter++);
+            auto frozen_iter = frozen.end(postorder, right_first);
+            for (auto iter = tree.end(postorder, right_first); iter != tree.begin(postorder, right_first);)
+                assert(*--iter == *--frozen_iter);
+            assert(frozen_iter == frozen.begin(postorder, right_first));
+            assert(frozen.root().second_child().parent() == frozen.root());
+        };
+        auto slot = [](auto const &frozen, auto iter) {
+            using node_type = typename std::decay_t<decltype(frozen)>::node_type;
+            return (reinterpret_cast<char const *>(&*iter) - reinterpret_cast<char const *>(&*frozen.root())) / sizeof(node_type);
+        };
+        auto by_level = freeze(tree);
+        check_orders(by_level);
+        assert(slot(by_level, by_level.root().second_child()) == 2);
+        assert(slot(by_level, by_level.root().first_child().first_child()) == 3);
+        auto by_blocks = freeze(tree, veb_layout);
+        check_orders(by_blocks);
+        assert(by_blocks == by_level);
+
+        // Complete tree of height 4: the top two levels come first, then each 3-node subtree below them.
+        binary_tree<int> complete;
+        complete.set_root(0);
+        std::vector<decltype(complete.root())> level{complete.root()};
+        for (std::size_t i = 0; level.size() < 15; ++i)
+        {
+            level.push_back(complete.new_child(level[i], int(level.size()), left_child));
+            level.push_back(complete.new_child(level[i], int(level.size()), right_child));
+        }
+        auto veb = freeze(complete, veb_layout);
+        std::vector<int> stored(veb.size());
+        for (auto iter = veb.begin(); iter != veb.end(); ++iter)
+            stored[slot(veb, iter)] = *iter;
+        assert((stored == std::vector<int>{0, 1, 2, 3, 7, 8, 4, 9, 10, 5, 11, 12, 6, 13, 14}));
+        auto copied = veb;
+        assert(copied == veb);
+        assert(frozen_tree<int>(complete, bfs_layout) == veb);
+        assert(freeze(binary_tree<int>()).empty());
+    }
+    {
+        auto map_written = [](auto const &source) {
+            using value_type = typename std::decay_t<decltype(source)>::value_type;
+            {
+                std::ofstream file("mapped_test.tree", std::ios::binary);
+                write_mapped(file, source);
+            }
+            mapped_tree<value_type> mapped("mapped_test.tree");
+            std::remove("mapped_test.tree");
+            return mapped;
+        };
+        auto mapped = map_written(tree);
+        assert(mapped.size() == 5 && mapped.depth() == tree.depth());
+        auto tree_iter = tree.begin(inorder);
+        for (auto &element : tree_iterate(mapped, inorder))
+            assert(element == *tree_iter++);
+        auto mapped_iter = mapped.end(postorder, right_first);
+        for (auto iter = tree.end(postorder, right_first); iter != tree.begin(postorder, right_first);)
+            assert(*--iter == *--mapped_iter);
+        auto level_iter = tree.begin(levelorder);
+        for (auto &element : level_order(mapped))
+            assert(element == *level_iter++);
+        assert(*mapped.root().first_child().second_child() == "left right");
+        mapped_string copied = *mapped.root();
+        assert(copied == *tree.root() && copied.str() == *tree.root());
+        std::vector<int> sorted(1000);
+        std::iota(sorted.begin(), sorted.end(), 0);
+        auto sorted_tree = binary_tree<int>::from_sorted(sorted.begin(), sorted.end());
+        auto mapped_numbers = map_written(sorted_tree);
+        assert(std::equal(mapped_numbers.begin(inorder), mapped_numbers.end(inorder), sorted.begin(), sorted.end()));
+        assert(mapped_numbers.depth() == sorted_tree.depth());
+        assert(map_written(binary_tree<int>()).empty());
+        {
+            std::ofstream file("mapped_test.tree", std::ios::binary);
+            write_mapped(file, sorted_tree);
+        }
+        // Opening only checks the header, validate checks the links and texts: 1 if opening failed, 2 if validate did.
+        auto rejected_by = [](std::string const &content, auto tree_type) {
+            {
+                std::ofstream file("mapped_test.tree", std::ios::binary);
+                file << content;
+            }
+            int stage = 1;
+            try
+            {
+                typename decltype(tree_type)::type mapped("mapped_test.tree");
+                stage = 2;
+                mapped.validate();
+                stage = 0;
+            }
+            catch (corrupt_data const &)
+            {
+            }
+            std::remove("mapped_test.tree");
+            return stage;
+        };
+        std::ostringstream written;
+        write_mapped(written, sorted_tree);
+        auto content = written.str();
+        struct of_numbers { using type = mapped_tree<int>; };
+        struct of_strings { using type = mapped_tree<std::string>; };
+        assert(rejected_by(content, of_numbers{}) == 0 && rejected_by(content, of_strings{}) == 1);
+        assert(rejected_by(content.substr(0, content.size() / 2), of_numbers{}) == 1);
+        assert(rejected_by("", of_numbers{}) == 1);
+        // The left child link of the root, which comes right after its value, pointed far outside the file.
+        static_assert(sizeof(compact_node<int>) == 4 * sizeof(std::int32_t));
+        auto far_link = content;
+        std::int32_t far = 1 << 30;
+        std::memcpy(&far_link[sizeof(tree::detail::mapped_header) + sizeof(int)], &far, sizeof far);
+        assert(rejected_by(far_link, of_numbers{}) == 2);
+        binary_tree<std::string> texts;
+        texts.set_root("text");
+        std::ostringstream text_written;
+        write_mapped(text_written, texts);
+        auto long_text = text_written.str();
+        long_text[sizeof(tree::detail::mapped_header) + sizeof(std::int64_t)] = 100;
+        assert(rejected_by(text_written.str(), of_strings{}) == 0 && rejected_by(long_text, of_strings{}) == 2);
+    }
 }
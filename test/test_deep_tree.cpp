@@ -0,0 +1,35 @@
+#include <sstream>
+#include "test_deep_tree.hpp"
+#include "../binary_tree.hpp"
+#include "../save_load.hpp"
+#include "../persistent_tree.hpp"
+
+void test_deep_tree(std::size_t depth)
+{
+    using namespace ds_exp;
+    binary_tree<int> tree;
+    tree.set_root(0);
+    auto iter = tree.root();
+    for (std::size_t i = 1; i < depth; ++i)
+        iter = i % 3 ? tree.new_child(iter, int(i), left_child) : tree.new_child(iter, int(i), right_child);
+    assert(tree.depth() == depth);
+    assert(tree.subtree_depth(tree.root().first_child()) == depth - 1);
+    std::ostringstream out;
+    out << tree;
+    std::istringstream in(out.str());
+    binary_tree<int> parsed;
+    in >> parsed;
+    assert(parsed == tree);
+    assert(parsed.depth() == depth);
+    assert(*--parsed.end(preorder) == int(depth - 1));
+    auto copied = parsed;
+    assert(copied.depth() == depth);
+    persistent_tree<int> persistent(parsed);
+    auto snapshot = persistent;
+    auto deepest = persistent.begin(postorder);
+    persistent.assign(deepest, -1);
+    assert(*snapshot.begin(postorder) == int(depth - 1) && *persistent.begin(postorder) == -1);
+    assert(persistent.depth() == depth && persistent.to_binary_tree().depth() == depth);
+    parsed.clear();
+    assert(parsed.empty());
+}
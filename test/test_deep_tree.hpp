@@ -0,0 +1,7 @@
+#ifndef INC_201703_TEST_DEEP_TREE_HPP
+#define INC_201703_TEST_DEEP_TREE_HPP
+
+#include <cstddef>
+
+void test_deep_tree(std::size_t depth);
+#endif //INC_201703_TEST_DEEP_TREE_HPP
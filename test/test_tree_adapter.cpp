@@ -1,5 +1,20 @@
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <thread>
 #include "test_tree_adapter.hpp"
 #include "../tree_adapter.hpp"
+#include "../string_pool.hpp"
+#include "../console_ui.hpp"
+
+namespace
+{
+    struct ordered_index_traits : ds_exp::ordered_traits
+    {
+        static constexpr bool key_index = true;
+    };
+}
 
 void test_tree_adapter()
 {
@@ -20,6 +35,9 @@ void test_tree_adapter()
     adapter.Assign("left", 5);
     assert(adapter.Value("left") == 5);
     adapter.Assign("left", 2);
+    auto assigned = adapter.AssignAt(adapter.get_iterator("right"), 6);
+    assert(get_value(*assigned) == 6 && adapter.Value("right") == 6);
+    adapter.AssignAt(assigned, 4);
     assert(adapter.Parent("left") == adapter.Root());
     assert(get_value(*adapter.Child("left", left_child)) == 3);
     assert(get_value(*adapter.Child("right", right_child)) == 5);
@@ -28,7 +46,8 @@ void test_tree_adapter()
     auto right_node = adapter.Child("root", right_child);
     decltype(adapter) new_adapter;
     new_adapter.CreateBiTree(definition);
-    adapter.InsertChild<right_t>(right_node, new_adapter);
+    auto farest = adapter.InsertChild<right_t>(right_node, new_adapter);
+    assert(get_key(*farest) == "right right");
     decltype(adapter) equals;
     equals.CreateBiTree(
         R"~([(root, 1), (left, 2),(left left,3),null,null,null,(right,4),null, (root, 1), (left,2),(left left,3),null,null,null,(right,4),null,(right right, 5),null, (right right,5),null,null])~");
@@ -40,4 +59,299 @@ void test_tree_adapter()
     adapter.InsertChild(right_node, replaced, right_child);
     equals.CreateBiTree(definition);
     assert(adapter == equals);
+    std::atomic<int> sum{0};
+    adapter.ParallelTraverse([&sum](auto const &element) { sum += get_value(element); });
+    assert(sum == 15);
+    auto concat = [](std::string lhs, std::string const &rhs) { return lhs + rhs; };
+    auto key_of = [](auto const &element) { return get_key(element) + ";"; };
+    std::string sequential_keys;
+    adapter.Traverse([&](auto const &element) { sequential_keys += key_of(element); }, postorder);
+    assert(adapter.ParallelReduce(""s, concat, key_of, postorder) == sequential_keys);
+    sequential_keys.clear();
+    adapter.LevelOrderTraverse([&](auto const &element) { sequential_keys += key_of(element); });
+    std::string level_keys;
+    adapter.ParallelLevelOrderTraverse([&](auto const &element) { level_keys += key_of(element); });
+    assert(level_keys == sequential_keys);
+    tree_adapter<std::string, int, indexed_traits> indexed;
+    indexed.CreateBiTree(definition);
+    std::string_view left_key = "left";
+    assert(indexed.Value(left_key) == 2);
+    assert(indexed.Parent("left left"sv) == indexed.get_iterator("left"));
+    assert(get_value(*indexed.Sibling("right"sv, left_child)) == 2);
+    indexed.Assign(left_key, 7);
+    auto indexed_copy = indexed;
+    indexed_copy.Assign("left", 8);
+    assert(indexed.Value("left") == 7 && indexed_copy.Value("left") == 8);
+    auto rejected = false;
+    try
+    {
+        indexed.InsertChild(indexed.get_iterator("right right"), indexed_copy, left_child);
+    }
+    catch (decltype(indexed)::precondition_failed_to_satisfy const &)
+    {
+        rejected = true;
+    }
+    assert(rejected && indexed.BiTreeDepth() == 3);
+    decltype(indexed) branch;
+    branch.CreateBiTree("[(a, 10), (b, 11), null, null, null]");
+    indexed.InsertChild(indexed.get_iterator("right right"), branch, left_child);
+    assert(indexed.Value("b") == 11 && indexed.BiTreeDepth() == 5);
+    auto removed_branch = indexed.DeleteChild(indexed.get_iterator("right right"), left_child);
+    assert(removed_branch.Value("a") == 10);
+    rejected = false;
+    try
+    {
+        indexed.Value("a");
+    }
+    catch (decltype(indexed)::precondition_failed_to_satisfy const &)
+    {
+        rejected = true;
+    }
+    assert(rejected);
+    rejected = false;
+    try
+    {
+        indexed.CreateBiTree("[(twice, 1), (twice, 2), null, null, null]");
+    }
+    catch (decltype(indexed)::precondition_failed_to_satisfy const &)
+    {
+        rejected = true;
+    }
+    assert(rejected && indexed.Value("right") == 4);
+    {
+        auto duplicated = "1 [(twice, 1), (twice, 2), null, null, null]"s;
+        std::istringstream in(duplicated);
+        rejected = false;
+        try
+        {
+            in >> indexed;
+        }
+        catch (decltype(indexed)::precondition_failed_to_satisfy const &)
+        {
+            rejected = true;
+        }
+        assert(rejected && indexed.Value("left") == 7 && indexed.Value("right") == 4);
+        rejected = false;
+        try
+        {
+            assign_element(duplicated, indexed);
+        }
+        catch (decltype(indexed)::precondition_failed_to_satisfy const &)
+        {
+            rejected = true;
+        }
+        assert(rejected && indexed.Value("left") == 7 && indexed.Value("right") == 4);
+    }
+    tree_adapter<std::string, null_value_tag, indexed_traits> key_only;
+    key_only.CreateBiTree("[root, left, null, null, right, null, null]");
+    key_only.Assign("left"sv, "renamed"s);
+    assert(key_only.Parent("renamed") == key_only.Root());
+    assert(key_only.Child("root", left_child) == key_only.get_iterator("renamed"sv));
+    indexed.ClearBiTree();
+    assert(indexed.BiTreeEmpty());
+    tree_adapter<std::string, int, ordered_traits> ordered;
+    ordered.CreateBiTree(definition);
+    std::string sorted_keys;
+    ordered.Traverse([&sorted_keys](auto const &element) { sorted_keys += get_key(element) + ";"; }, inorder);
+    assert(sorted_keys == "left;left left;right;right right;root;");
+    assert(ordered.Value("right right"sv) == 5);
+    ordered.Insert("middle", 6);
+    ordered.Erase("left left");
+    assert(get_key(*ordered.LowerBound("m")) == "middle");
+    assert(get_key(*ordered.LowerBound("right")) == "right");
+    assert(get_key(*ordered.UpperBound("right")) == "right right");
+    assert(ordered.UpperBound("z") == ordered.get_end_iterator(inorder));
+    rejected = false;
+    try
+    {
+        ordered.Insert("middle", 7);
+    }
+    catch (decltype(ordered)::precondition_failed_to_satisfy const &)
+    {
+        rejected = true;
+    }
+    assert(rejected && ordered.Value("middle") == 6);
+    for (int i = 0; i < 1000; ++i)
+        ordered.Insert("key " + std::to_string(i * 7919 % 1000 + 1000), i);
+    assert(ordered.BiTreeDepth() <= 15);
+    for (int i = 1000; i < 2000; i += 2)
+        ordered.Erase("key " + std::to_string(i));
+    assert(ordered.BiTreeDepth() <= 14);
+    int in_range = 0;
+    for (auto iter = ordered.LowerBound("key 1100"); iter != ordered.UpperBound("key 1200"); ++iter)
+        ++in_range;
+    assert(in_range == 50);
+    tree_adapter<std::string, null_value_tag, ordered_index_traits> ordered_keys;
+    ordered_keys.CreateBiTree("[c, b, a, null, null, null, d, null, null]");
+    ordered_keys.Assign("a", "e"s);
+    assert(*ordered_keys.LowerBound("a") == "b" && *ordered_keys.UpperBound("d") == "e");
+    assert(ordered_keys.get_iterator("e"sv) == ordered_keys.UpperBound("d"));
+    ordered_keys.Erase("c"sv);
+    assert(*ordered_keys.UpperBound("b") == "d");
+    tree_adapter<std::string, int, cached_depth_traits> cached;
+    cached.CreateBiTree(definition);
+    assert(cached.BiTreeDepth() == 3);
+    decltype(cached) inserted;
+    inserted.CreateBiTree(definition);
+    cached.InsertChild(cached.Child("right", right_child), inserted, left_child);
+    assert(cached.BiTreeDepth() == 6);
+    cached.DeleteChild(cached.get_iterator("right right"), left_child);
+    assert(cached.BiTreeDepth() == 3);
+    cached.ClearBiTree();
+    assert(cached.BiTreeDepth() == 0);
+    tree_adapter<std::string, int, threaded_traits> threaded;
+    threaded.CreateBiTree(definition);
+    threaded.InsertChild(threaded.Child("left", left_child), threaded, right_child);
+    std::string keys;
+    threaded.Traverse([&keys](auto const &element) { keys += get_key(element) + ";"; }, inorder);
+    assert(keys == "left left;left left;left;root;right;right right;left;root;right;right right;");
+    tree_adapter<std::string, null_value_tag, hashed_traits> hashed, hashed_other;
+    hashed.CreateBiTree("[root, left, null, null, right, null, null]");
+    hashed_other.CreateBiTree("[root, left, null, null, right, null, null]");
+    assert(hashed.Hash() == hashed_other.Hash() && hashed == hashed_other);
+    auto saved = hashed.Hash();
+    hashed.Assign("left", "renamed"s);
+    assert(hashed.ChangedSince(saved) && !(hashed == hashed_other));
+    hashed.Assign("renamed", "left"s);
+    assert(!hashed.ChangedSince(saved));
+    hashed.DeleteChild(hashed.Root(), right_child);
+    assert(hashed.ChangedSince(saved));
+    static_assert(sizeof(interned_string) == sizeof(char const *));
+    string_pool pool;
+    auto pooled = pool.intern("pooled"sv);
+    assert(pool.intern("pooled"s) == pooled && pool.intern("other"sv) != pooled && pool.size() == 2);
+    assert(pool.intern(""sv) == nullptr);
+    bool unscoped = false;
+    try
+    {
+        interned_string outside("outside");
+    }
+    catch (std::logic_error const &)
+    {
+        unscoped = true;
+    }
+    assert(unscoped && interned_string().empty());
+    string_pool::scope use(pool);
+    string_pool other_pool;
+    assert(interned_string("elsewhere", other_pool) == "elsewhere"sv && other_pool.size() == 1 && pool.size() == 2);
+    bool other_thread_unscoped = false;
+    std::thread([&other_thread_unscoped] {
+        try
+        {
+            interned_string outside("outside");
+        }
+        catch (std::logic_error const &)
+        {
+            other_thread_unscoped = true;
+        }
+    }).join();
+    assert(other_thread_unscoped);
+    interned_string left("left"), left_again("left"s), empty;
+    assert(left == left_again && left.c_str() == left_again.c_str() && left == "left"sv && left != "right"sv);
+    assert(left.size() == 4 && empty.empty() && empty == interned_string(""sv) && empty.view().empty());
+    assert(interned_string("a") < interned_string("b") && !(left < left_again));
+    assert(pool.size() == 5 && std::hash<interned_string>{}(left) == std::hash<std::string_view>{}("left"sv));
+    tree_adapter<interned_string, interned_string> interned;
+    interned.CreateBiTree("[(root, r), (left, l), null, null, (right, r), null, null]");
+    assert(get_key(*interned.Parent("left")) == "root"sv);
+    assert(get_value(*interned.Parent("right")).c_str() == get_value(*interned.Root()).c_str());
+    interned.Assign("left", interned_string("renamed"));
+    assert(interned.Value("left") == "renamed"sv);
+    tree_adapter<interned_string, null_value_tag, indexed_traits> interned_keys;
+    interned_keys.CreateBiTree("[root, left, null, null, right, null, null]");
+    interned_keys.Assign("left", interned_string("middle"));
+    assert(get_key(*interned_keys.Parent(interned_string("middle"))) == "root"sv);
+    std::ostringstream saved_line;
+    saved_line << adapter;
+    decltype(adapter) loaded, absent;
+    assign_element(saved_line.str(), loaded);
+    assert(loaded == adapter && loaded.Value("right right") == 5);
+    std::istringstream streamed(saved_line.str() + " after\n" + saved_line.str());
+    decltype(adapter) first, second;
+    std::string after;
+    streamed >> first >> after >> second;
+    assert(first == adapter && after == "after" && second == adapter);
+    absent.InitBiTree();
+    assign_element("0 "s, absent);
+    bool destroyed = false;
+    try
+    {
+        absent.BiTreeEmpty();
+    }
+    catch (decltype(absent)::tree_not_exist const &)
+    {
+        destroyed = true;
+    }
+    assert(destroyed);
+    {
+        std::ofstream file("mapped_test.tree", std::ios::binary);
+        write_mapped(file, adapter);
+    }
+    mapped_adapter<std::string, int> mapped("mapped_test.tree");
+    std::remove("mapped_test.tree");
+    mapped.Validate();
+    assert(mapped.BiTreeDepth() == adapter.BiTreeDepth() && get_key(*mapped.Root()) == "root");
+    assert(mapped.Value("right right") == 5 && mapped.Value("left left", postorder) == 3);
+    std::string mapped_keys;
+    mapped.LevelOrderTraverse([&](auto const &element) { mapped_keys += get_key(element).str() + ";"; });
+    assert(mapped_keys == sequential_keys);
+    {
+        std::ofstream file("mapped_test.tree", std::ios::binary);
+        write_mapped(file, interned);
+    }
+    mapped_adapter<interned_string, interned_string> mapped_interned("mapped_test.tree");
+    std::remove("mapped_test.tree");
+    assert(mapped_interned.Value("left") == "renamed"sv);
+    std::string interned_keys_seen;
+    mapped_interned.Traverse([&](auto const &element) { interned_keys_seen += get_key(element).view(); }, inorder);
+    assert(interned_keys_seen == "leftrootright");
+    bool missing = false;
+    try
+    {
+        mapped_interned.Value("absent");
+    }
+    catch (decltype(mapped_interned)::precondition_failed_to_satisfy const &)
+    {
+        missing = true;
+    }
+    assert(missing);
+
+    // The container of all trees of a console: a round trip, and damaged files that must leave the trees alone.
+    console_ui<std::string, int> registry, reloaded;
+    std::istringstream("second\n3\nfirst\n1 [(comma\\, key, 1), (back\\\\slash, 2), null, null, null]\n"
+                       "second\n1 [(plain, 3), null, (right, 4), null, null]\nnone\n0\n") >> registry;
+    auto container_of = [](auto const &ui) {
+        std::ostringstream out;
+        write_container(out, ui);
+        return out.str();
+    };
+    auto container = container_of(registry);
+    std::istringstream container_in(container);
+    read_container(container_in, reloaded);
+    assert(container_in && container_of(reloaded) == container);
+    auto header_end = container.find('[');
+    auto corrupt = [&](std::string const &damaged) {
+        std::istringstream in(damaged);
+        auto failed = false;
+        try
+        {
+            read_container(in, reloaded);
+            failed = !in;
+        }
+        catch (std::logic_error const &)
+        {
+            failed = true;
+        }
+        return failed && container_of(reloaded) == container;
+    };
+    auto damaged_at = [&container](std::string const &from, std::string const &to) {
+        auto damaged = container;
+        return damaged.replace(damaged.find(from), from.size(), to);
+    };
+    assert(corrupt(container.substr(0, header_end / 2)));
+    assert(corrupt(container.substr(0, container.size() - 1)));
+    assert(corrupt("x" + container.substr(1)));
+    assert(corrupt(damaged_at("\n3\n", "\n99999999999999\n")));
+    assert(corrupt(damaged_at("\n0 ", "\n99999999999999 ")));
+    assert(corrupt(damaged_at("\n0 ", "\n0 99999999999999")));
 }
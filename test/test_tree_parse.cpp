@@ -1,7 +1,11 @@
+#include <limits>
 #include <string>
 #include <sstream>
 #include "test_tree_parse.hpp"
 #include "../tree_parse.hpp"
+#include "../structural_index.hpp"
+#include "../push_parse.hpp"
+#include "../binary_format.hpp"
 #include "../tree_adapter.hpp"
 
 void test_tree_parse()
@@ -31,4 +35,179 @@ void test_tree_parse()
     decltype(tree) new_tree;
     new_istream >> new_tree;
     assert(tree == new_tree);
+    assert(output == R"~([(\,,1),([,2),(\\,3),null,null,null,(\),4),null,null])~");
+
+    buffer_parse<left_first_t, adapter::detail::stored_t<std::string, int>> buffer(output);
+    assert(buffer.get_binary_tree().value() == tree);
+    assert(buffer.reader().position() == output.size());
+    auto text = R"~([(\\,1), (\)\,,2), null, null, null] trailing)~"sv;
+    buffer_parse<left_first_t, std::string> strings(text);
+    auto parsed = strings.get_binary_tree().value();
+    assert(*parsed.root() == "\\\\,1" && *parsed.root().first_child() == ")\\,,2");
+    assert(text.substr(strings.reader().position()) == " trailing");
+    buffer_parse<left_first_t, double> numbers(" [ 1.5 , +2, (-3e2), null, null, null, null ]"sv);
+    auto number_tree = numbers.get_binary_tree().value();
+    assert(*number_tree.root() == 1.5 && *number_tree.root().first_child() == 2 && *number_tree.root().first_child().first_child() == -300);
+    *number_tree.root() = 0.1;
+    std::ostringstream numbers_out;
+    numbers_out << number_tree;
+    assert(numbers_out.str() == "[(0.1),(2),(-300),null,null,null,null]");
+    // Elements longer than the output buffer are written around it.
+    binary_tree<std::string> long_text;
+    long_text.set_root(std::string(100000, ')'));
+    long_text.new_child(long_text.root(), "short", right_child);
+    std::ostringstream long_out;
+    long_out << long_text;
+    std::string escaped_long;
+    for (int i = 0; i < 100000; ++i)
+        escaped_long += "\\)";
+    assert(long_out.str() == "[(" + escaped_long + "),null,(short),null,null]");
+    assert((buffer_parse<left_first_t, std::string>(long_out.str()).get_binary_tree().value() == long_text));
+    bool rejected = false;
+    try
+    {
+        buffer_parse<left_first_t, int>("[1x, null, null]"sv).get_binary_tree();
+    }
+    catch (parse_failed const &)
+    {
+        rejected = true;
+    }
+    assert(rejected);
+    rejected = false;
+    try
+    {
+        buffer_parse<left_first_t, int>("[1, null"sv).get_binary_tree();
+    }
+    catch (expect_failed const &)
+    {
+        rejected = true;
+    }
+    assert(rejected);
+
+    // Blocks of every kind of character, with escapes crossing the block boundaries.
+    std::string noisy;
+    for (std::size_t i = 0; i < 1000; ++i)
+        noisy.push_back(",])(\\ab"[i * 2654435761u % 7]);
+    std::vector<std::size_t> scanned;
+    for (std::size_t i = 0; i < noisy.size(); ++i)
+        if ((noisy[i] == ',' || noisy[i] == ']' || noisy[i] == ')') && (i == 0 || noisy[i - 1] != '\\'))
+            scanned.push_back(i);
+    for (auto kernel : {index_kernel::scalar, index_kernel::sse2, index_kernel::avx2})
+    {
+        parse::detail::indexed_reader reader(noisy, kernel);
+        std::vector<std::size_t> stops;
+        for (reader.read_until(false, ',', ']', ')'); reader.position() != noisy.size(); reader.read_until(false, ',', ']', ')'))
+        {
+            stops.push_back(reader.position());
+            reader.read_char(noisy[reader.position()]);
+        }
+        assert(stops == scanned);
+    }
+    indexed_parse<left_first_t, adapter::detail::stored_t<std::string, int>> indexed(output);
+    assert(indexed.get_binary_tree().value() == tree);
+    indexed_parse<left_first_t, std::string> indexed_strings(text);
+    assert(indexed_strings.get_binary_tree().value() == parsed);
+    assert(text.substr(indexed_strings.reader().position()) == " trailing");
+    std::string long_definition = "[";
+    for (int i = 0; i < 300; ++i)
+        long_definition += "(" + std::to_string(i) + "), ";
+    for (int i = 0; i < 300; ++i)
+        long_definition += "null, ";
+    long_definition += "null]";
+    auto from_index = indexed_parse<left_first_t, int>(long_definition).get_binary_tree().value();
+    assert((from_index == buffer_parse<left_first_t, int>(long_definition).get_binary_tree().value()) && from_index.depth() == 300);
+
+    // Chunks of every size up to the whole text, cutting escapes and elements anywhere.
+    for (std::size_t chunk = 1; chunk <= output.size(); chunk += chunk < 8 ? 1 : 13)
+    {
+        push_parse<left_first_t, adapter::detail::stored_t<std::string, int>> pushed;
+        std::string finished;
+        pushed.on_subtree([&finished](auto iter) { finished += iter->key; });
+        for (std::size_t used = 0; used < output.size(); used += chunk)
+            pushed.feed(std::string_view(output).substr(used, chunk));
+        assert(pushed.done() && finished == "\\[),");
+        assert(pushed.get_binary_tree().value() == tree);
+    }
+    push_parse<left_first_t, std::string> pushed_strings;
+    assert(pushed_strings.feed(text.substr(0, 10)) == 10 && !pushed_strings.done());
+    auto used = pushed_strings.feed(text.substr(10));
+    assert(pushed_strings.done() && text.substr(10 + used) == " trailing");
+    assert(pushed_strings.get_binary_tree().value() == parsed);
+    push_parse<left_first_t, int> pushed_numbers;
+    pushed_numbers.feed(long_definition);
+    assert(pushed_numbers.get_binary_tree().value() == from_index);
+    push_parse<left_first_t, int> empty_tree, incomplete;
+    empty_tree.feed(" [ null ] ");
+    assert(!empty_tree.get_binary_tree());
+    incomplete.feed("[1, null");
+    rejected = false;
+    try
+    {
+        incomplete.get_binary_tree();
+    }
+    catch (unexpected_end const &)
+    {
+        rejected = true;
+    }
+    assert(rejected);
+
+    // Binary form: written next to text, read back by operator>> and checked for damage.
+    std::ostringstream binary_out;
+    write_binary(binary_out, tree) << " ";
+    write_binary(binary_out, from_index) << " " << from_index;
+    binary_tree<double> reals;
+    reals.set_root(-0.5);
+    reals.new_child(reals.root(), 1e300, right_child);
+    write_binary(binary_out, reals);
+    auto binary = binary_out.str();
+    std::istringstream binary_in(binary);
+    binary_tree<adapter::detail::stored_t<std::string, int>> tree_back;
+    binary_tree<int> numbers_back, text_back;
+    binary_tree<double> reals_back;
+    binary_in >> tree_back >> numbers_back >> text_back >> reals_back;
+    assert(tree_back == tree && numbers_back == from_index && text_back == from_index && reals_back == reals);
+    binary_tree<int> negatives;
+    negatives.set_root(-1);
+    negatives.new_child(negatives.root(), std::numeric_limits<int>::min(), left_child);
+    std::ostringstream negatives_out;
+    write_binary(negatives_out, negatives);
+    std::istringstream negatives_in(negatives_out.str());
+    negatives_in >> numbers_back;
+    assert(numbers_back == negatives);
+    for (std::size_t damaged : {std::size_t(8), binary_header_size, binary_header_size + 5})
+    {
+        auto copy = binary;
+        copy[damaged] ^= 0x10;
+        std::istringstream damaged_in(copy);
+        rejected = false;
+        try
+        {
+            damaged_in >> tree_back;
+        }
+        catch (corrupt_data const &)
+        {
+            rejected = true;
+        }
+        assert(rejected);
+    }
+    // A header that passes its checksum but promises far more payload than there is, or more nodes than fit into it.
+    for (auto [count, payload_size] : {std::pair{std::uint64_t(1), std::uint64_t(1) << 40}, std::pair{~std::uint64_t(0), std::uint64_t(16)}})
+    {
+        auto forged = binary.substr(0, 5);
+        tree::detail::put_fixed(forged, count, 8);
+        tree::detail::put_fixed(forged, payload_size, 8);
+        forged += binary.substr(21, 4);
+        tree::detail::put_fixed(forged, tree::detail::checksum(forged), 4);
+        std::istringstream forged_in(forged + binary.substr(binary_header_size));
+        rejected = false;
+        try
+        {
+            forged_in >> tree_back;
+        }
+        catch (corrupt_data const &)
+        {
+            rejected = true;
+        }
+        assert(rejected && tree_back == tree);
+    }
 }
@@ -1,14 +1,22 @@
 #ifndef INC_201703_TREE_ADAPTER_HPP
 #define INC_201703_TREE_ADAPTER_HPP
 
+#include <algorithm>
+#include <istream>
 #include <optional>
 #include <stdexcept>
 #include <string>
 #include <string_view>
-#include <queue>
+#include <unordered_map>
 #include "binary_tree.hpp"
 #include "tree_parse.hpp"
+#include "structural_index.hpp"
+#include "push_parse.hpp"
 #include "save_load.hpp"
+#include "binary_format.hpp"
+#include "mapped_tree.hpp"
+#include "tree_parallel.hpp"
+#include "ordered_tree.hpp"
 
 namespace ds_exp
 {
@@ -24,11 +32,18 @@ namespace ds_exp
                 Value value;
                 friend std::ostream &operator<<(std::ostream &out, stored_t const &s)
                 {
-                    escape(out, s.key, ',', '\\') << ",";
-                    escape(out, s.value, ',', '\\');
-                    return out;
+                    return escape(out, s);
                 }
             };
+            // The key and the value are escaped once, together with the characters the enclosing text escapes.
+            template <typename Buffer, typename Key, typename Value, typename ...Escaped>
+            void put_element(Buffer &out, stored_t<Key, Value> const &s, Escaped ...escaped)
+            {
+                using ds_exp::put_element;
+                put_element(out, s.key, ',', '\\', escaped...);
+                out.put(',');
+                put_element(out, s.value, ',', '\\', escaped...);
+            }
             template <typename T>
             auto const &get_key(T const &t)
             {
@@ -115,16 +130,35 @@ namespace ds_exp
                 using key_type = Key;
                 using value_type = Key;
             };
+            // Splits "key, value" at the first unescaped comma.
             template <typename Key, typename Value>
-            void assign_element(std::string str, detail::stored_t<Key, Value> &v)
+            void assign_element(std::string_view str, detail::stored_t<Key, Value> &v)
             {
                 using ds_exp::assign_element;
-                std::istringstream source(str);
-                auto key_input = parse::detail::read_until(source, true, ',');
-                parse::detail::force_read_char(source, ',');
-                auto value_input = parse::detail::read_until(source, true);
-                assign_element(std::move(key_input), v.key);
-                assign_element(std::move(value_input), v.value);
+                parse::detail::buffer_reader source(str);
+                assign_element(source.read_until(true, ','), v.key);
+                source.force_read_char(',');
+                assign_element(source.read_until(true), v.value);
+            }
+            template <typename Key, typename Value>
+            void assign_element(std::string str, detail::stored_t<Key, Value> &v)
+            {
+                assign_element(std::string_view(str), v);
+            }
+            // The binary form stores the key and the value one after the other, so no escaping is needed.
+            template <typename Key, typename Value>
+            void put_binary(std::string &out, stored_t<Key, Value> const &s)
+            {
+                using ds_exp::put_binary;
+                put_binary(out, s.key);
+                put_binary(out, s.value);
+            }
+            template <typename Key, typename Value>
+            void get_binary(std::string_view &in, stored_t<Key, Value> &s)
+            {
+                using ds_exp::get_binary;
+                get_binary(in, s.key);
+                get_binary(in, s.value);
             }
         }
         using detail::get_key;
@@ -133,17 +167,81 @@ namespace ds_exp
 
         using namespace std::literals;
 
-        template <typename Key_t, typename Value_t = null_value_tag>
+        // Policies of a tree_adapter. Derive from it and override members to opt in to a feature.
+        struct default_adapter_traits
+        {
+            using augment = no_augment;
+            static constexpr bool key_index = false;
+            static constexpr bool ordered = false;
+            using compare = std::less<>;
+        };
+        // Keeps the height of every subtree, so BiTreeDepth doesn't have to scan the tree.
+        struct cached_depth_traits : default_adapter_traits
+        {
+            using augment = height_augment;
+        };
+        // Threads every node to its in-order neighbours, so inorder traversal steps are constant time.
+        struct threaded_traits : default_adapter_traits
+        {
+            using augment = inorder_threads;
+        };
+        // Finds nodes by key through a hash index instead of a traversal. Keys have to be unique and convertible
+        // to std::string_view, and may only be changed through Assign.
+        struct indexed_traits : default_adapter_traits
+        {
+            static constexpr bool key_index = true;
+        };
+        // Keeps the tree an AVL tree whose inorder sequence is sorted by key, so keyed operations take O(log n) and
+        // LowerBound/UpperBound start inorder range scans. The balancing decides the shape, so InsertChild and
+        // DeleteChild aren't available; elements are added and removed with Insert and Erase.
+        struct ordered_traits : default_adapter_traits
+        {
+            using augment = height_augment;
+            static constexpr bool ordered = true;
+        };
+
+        // Hashes the key of an element, as elements compare equal by their keys.
+        struct element_key_hash
+        {
+            template <typename Element>
+            std::uint64_t operator()(Element const &element) const
+            {
+                auto &key = get_key(element);
+                return std::hash<std::decay_t<decltype(key)>>{}(key);
+            }
+        };
+        // Keeps a Merkle hash of every subtree, so unequal trees are told apart in O(1) and Hash tells whether a tree
+        // changed since an earlier Hash. Like equality it covers the keys and the shape, not the values.
+        struct hashed_traits : default_adapter_traits
+        {
+            using augment = hash_augment<element_key_hash>;
+        };
+
+        template <typename Key_t, typename Value_t = null_value_tag, typename Traits = default_adapter_traits>
         class tree_adapter
         {
         public:
+            using traits_type = Traits;
             using element_type = typename value_traits<Key_t, Value_t>::type;
-            using tree_type = binary_tree<element_type>;
+            using tree_type = binary_tree<element_type, std::allocator<element_type>, typename traits_type::augment>;
             using key_type = typename value_traits<Key_t, Value_t>::key_type;
             using value_type = typename value_traits<Key_t, Value_t>::value_type;
 
         private:
+            using handler_type = typename tree_type::handler_type;
+            struct no_index
+            {
+            };
+            // Wrapping the node keeps detail's catch-all comparisons of elements out of the map's iterators.
+            struct index_entry
+            {
+                handler_type node;
+            };
+            // Views of the keys stored in the nodes, which never move while they are in a tree.
+            using index_type = std::conditional_t<traits_type::key_index, std::unordered_map<std::string_view, index_entry>, no_index>;
+
             std::optional<tree_type> tree;
+            index_type index;
 
             tree_adapter(tree_type &&tree)
                 :tree(std::move(tree))
@@ -179,35 +277,46 @@ namespace ds_exp
             };
 
             tree_adapter() = default;
+            tree_adapter(tree_adapter const &src)
+                : tree(src.tree), index(index_of(tree, __func__))
+            {
+            }
+            tree_adapter(tree_adapter &&) = default;
+            tree_adapter &operator=(tree_adapter const &src)
+            {
+                return *this = tree_adapter(src);
+            }
+            tree_adapter &operator=(tree_adapter &&) = default;
+
             void InitBiTree()
             {
                 if (tree)
                     throw tree_exists(__func__);
-                tree = binary_tree<element_type>();
+                tree = tree_type();
+                index = index_type();
             }
             void DestroyBiTree()
             {
                 if (!tree)
                     throw tree_not_exist(__func__);
                 tree.reset();
+                index = index_type();
             }
             void CreateBiTree(std::istream &definition)
             {
-                auto generated_tree = tree_parse<left_first_t, element_type>(definition).get_binary_tree();
-                if (!generated_tree)
-                    throw parse_failed(__func__);
-                tree = generated_tree;
+                create(tree_parse<left_first_t, element_type, std::allocator<element_type>, typename traits_type::augment>(definition).get_binary_tree());
             }
-            void CreateBiTree(std::string const &string)
+            // Parses the definition in place instead of through a stream.
+            void CreateBiTree(std::string_view definition)
             {
-                std::istringstream stream(string);
-                CreateBiTree(stream);
+                create(indexed_parse<left_first_t, element_type, std::allocator<element_type>, typename traits_type::augment>(definition).get_binary_tree());
             }
             void ClearBiTree()
             {
                 if (!tree)
                     throw tree_not_exist(__func__);
                 tree->clear();
+                index = index_type();
             }
             auto BiTreeEmpty() const
             {
@@ -227,51 +336,87 @@ namespace ds_exp
                     throw tree_not_exist(__func__);
                 return tree->root();
             }
-            template <typename order_t = preorder_t, typename dir_t = left_first_t>
-            auto &Value(key_type const &key, order_t order = order_t{}, dir_t dir = dir_t{}) const
+            // Keyed operations accept anything comparable with the keys; indexed adapters also take std::string_view.
+            template <typename K, typename order_t = preorder_t, typename dir_t = left_first_t>
+            auto &Value(K const &key, order_t order = order_t{}, dir_t dir = dir_t{}) const
             {
                 if (!tree)
                     throw tree_not_exist(__func__);
-                for (auto &element : tree_iterate(*tree, order, dir))
-                    if(element == key)
-                        return get_value(element);
+                if (auto iter = find(*this, key, order, dir))
+                    return get_value(*iter);
                 throw precondition_failed_to_satisfy(__func__);
             }
-            template <typename U, typename order_t = preorder_t, typename dir_t = left_first_t>
-            void Assign(key_type const &key, U &&value, order_t order = order_t{}, dir_t dir = dir_t{})
+            template <typename K, typename U, typename order_t = preorder_t, typename dir_t = left_first_t>
+            void Assign(K const &key, U &&value, order_t order = order_t{}, dir_t dir = dir_t{})
             {
                 if (!tree)
                     throw tree_not_exist(__func__);
-                if (auto iter = std::find(tree->begin(order, dir), tree->end(order, dir), key))
-                    get_value(*iter) = std::forward<U>(value);
-                else
+                auto iter = find(*this, key, order, dir);
+                if (!iter)
                     throw precondition_failed_to_satisfy(__func__);
+                AssignAt(iter, std::forward<U>(value));
+            }
+            // Assign for an element already found. Returns the iterator to it, which only differs from pos in ordered
+            // adapters whose elements are the keys, as they move the element to its new place.
+            template <typename iter, typename U>
+            iter AssignAt(iter pos, U &&value)
+            {
+                if (!tree)
+                    throw tree_not_exist(__func__);
+                if constexpr ((traits_type::key_index || traits_type::ordered) && std::is_same_v<Value_t, null_value_tag>)
+                {
+                    // The element is the key itself, so it has to be filed again under the new key.
+                    element_type assigned(std::forward<U>(value));
+                    if (auto other = find(*this, assigned, preorder, left_first); other && other != pos)
+                        throw precondition_failed_to_satisfy(__func__);
+                    remove_from_index(*pos);
+                    if constexpr (traits_type::ordered)
+                    {
+                        avl_erase(*tree, pos);
+                        auto inserted = avl_insert(*tree, std::move(assigned), compare()).first;
+                        add_to_index(inserted);
+                        return inserted;
+                    }
+                    else
+                    {
+                        *pos = std::move(assigned);
+                        tree->value_changed(pos);
+                        add_to_index(pos);
+                        return pos;
+                    }
+                }
+                else
+                {
+                    get_value(*pos) = std::forward<U>(value);
+                    tree->value_changed(pos);
+                    return pos;
+                }
             }
 
-            template <typename order_t = preorder_t, typename dir_t = left_first_t>
-            auto Parent(key_type const &key, order_t order = order_t{}, dir_t dir = dir_t{}) const
+            template <typename K, typename order_t = preorder_t, typename dir_t = left_first_t>
+            auto Parent(K const &key, order_t order = order_t{}, dir_t dir = dir_t{}) const
             {
                 if (!tree)
                     throw tree_not_exist(__func__);
-                if (auto iter = std::find(tree->begin(order, dir), tree->end(order, dir), key))
+                if (auto iter = find(*this, key, order, dir))
                     return iter.parent();
                 throw precondition_failed_to_satisfy(__func__);
             }
-            template <typename child_t, typename order_t = preorder_t, typename dir_t = left_first_t>
-            auto Child(key_type const &key, child_t child = child_t{}, order_t order = order_t{}, dir_t dir = dir_t{}) const
+            template <typename K, typename child_t, typename order_t = preorder_t, typename dir_t = left_first_t>
+            auto Child(K const &key, child_t child = child_t{}, order_t order = order_t{}, dir_t dir = dir_t{}) const
             {
                 if (!tree)
                     throw tree_not_exist(__func__);
-                if (auto iter = std::find(tree->begin(order, dir), tree->end(order, dir), key))
+                if (auto iter = find(*this, key, order, dir))
                     return iter.first_child(child);
                 throw precondition_failed_to_satisfy(__func__);
             }
-            template <typename child_t, typename order_t = preorder_t, typename dir_t = left_first_t>
-            auto Sibling(key_type const &key, child_t child = child_t{}, order_t order = order_t{}, dir_t dir = dir_t{}) const
+            template <typename K, typename child_t, typename order_t = preorder_t, typename dir_t = left_first_t>
+            auto Sibling(K const &key, child_t child = child_t{}, order_t order = order_t{}, dir_t dir = dir_t{}) const
             {
                 if (!tree)
                     throw tree_not_exist(__func__);
-                if (auto iter = std::find(tree->begin(order, dir), tree->end(order, dir), key))
+                if (auto iter = find(*this, key, order, dir))
                 {
                     auto desired_child = iter.parent().first_child(child);
                     if (desired_child == iter)
@@ -280,23 +425,85 @@ namespace ds_exp
                 }
                 throw precondition_failed_to_satisfy(__func__);
             }
+            // The former child subtree is moved below the last node in inorder of direction dir, which is returned.
             template <typename child_t, typename iter, typename dir_t = right_t>
-            void InsertChild(iter pos, tree_adapter inserted, child_t child = child_t{}, dir_t dir = dir_t{})
+            auto InsertChild(iter pos, tree_adapter inserted, child_t child = child_t{}, dir_t dir = dir_t{})
             {
+                static_assert(!traits_type::ordered, "Ordered adapters choose the position of elements themselves.");
                 if (!tree)
                     throw tree_not_exist(__func__);
+                if constexpr (traits_type::key_index)
+                {
+                    for (auto &entry : inserted.index)
+                        if (index.count(entry.first))
+                            throw precondition_failed_to_satisfy(__func__);
+                }
                 auto replaced = tree->replace_child(pos, std::move(inserted.tree.value()), child);
                 auto farest = tree->begin(inorder, dir);
                 auto empty = tree->replace_child(farest, std::move(replaced), dir);
                 assert(empty.empty());
+                if constexpr (traits_type::key_index)
+                    index.merge(inserted.index);
+                return farest;
             }
             template <typename child_t, typename iter>
             auto DeleteChild(iter pos, child_t child = child_t{})
             {
+                static_assert(!traits_type::ordered, "Ordered adapters choose the position of elements themselves.");
+                if (!tree)
+                    throw tree_not_exist(__func__);
+                tree_adapter removed(tree->replace_child(pos, tree_type{}, child));
+                if constexpr (traits_type::key_index)
+                {
+                    for (auto &element : tree_iterate(*removed.tree, preorder))
+                        removed.index.insert(index.extract(key_view(element)));
+                }
+                return removed;
+            }
+            // Adds the element made of args to an ordered adapter and returns its inorder iterator.
+            template <typename... Args>
+            auto Insert(Args &&... args)
+            {
+                static_assert(traits_type::ordered, "Insert needs an ordered adapter.");
+                if (!tree)
+                    throw tree_not_exist(__func__);
+                auto [iter, inserted] = avl_insert(*tree, element_type{std::forward<Args>(args)...}, compare());
+                if (!inserted)
+                    throw precondition_failed_to_satisfy(__func__);
+                add_to_index(iter);
+                return iter;
+            }
+            template <typename K>
+            void Erase(K const &key)
+            {
+                static_assert(traits_type::ordered, "Erase needs an ordered adapter.");
                 if (!tree)
                     throw tree_not_exist(__func__);
-                return tree_adapter(tree->replace_child(pos, tree_type{}, child));
+                auto iter = find(*this, key, inorder, left_first);
+                if (!iter)
+                    throw precondition_failed_to_satisfy(__func__);
+                remove_from_index(*iter);
+                avl_erase(*tree, iter);
             }
+            // First element whose key isn't less than key, and first element whose key is greater than key.
+            // Both are inorder iterators, to be walked up to get_end_iterator(inorder).
+            template <typename K>
+            auto LowerBound(K const &key) const
+            {
+                static_assert(traits_type::ordered, "LowerBound needs an ordered adapter.");
+                if (!tree)
+                    throw tree_not_exist(__func__);
+                return bst_lower_bound(*tree, key, compare());
+            }
+            template <typename K>
+            auto UpperBound(K const &key) const
+            {
+                static_assert(traits_type::ordered, "UpperBound needs an ordered adapter.");
+                if (!tree)
+                    throw tree_not_exist(__func__);
+                return bst_upper_bound(*tree, key, compare());
+            }
+
             template <typename Callable, typename order_t, typename dir_t = left_first_t>
             void Traverse(Callable callable, order_t order, dir_t dir = dir_t{})
             {
@@ -310,26 +517,40 @@ namespace ds_exp
             {
                 if (!tree)
                     throw tree_not_exist(__func__);
-                auto iter = tree->root(preorder, dir);
-                if(!iter)
-                    return;
-                std::queue<decltype(iter)> queue;
-                queue.push(iter);
-                while (!queue.empty())
-                {
-                    iter = queue.front(), queue.pop();
-                    if (iter.first_child(dir))
-                        queue.push(iter.first_child(dir));
-                    if (iter.second_child(dir))
-                        queue.push(iter.second_child(dir));
-                    callable(*iter);
-                }
+                for (auto &element : level_order(*tree, dir))
+                    callable(element);
             }
 
-            template <typename order_t = preorder_t, typename dir_t = left_first_t>
-            auto get_iterator(key_type const &key, order_t order = order_t{}, dir_t dir = dir_t{})
+            // Calls callable on every element from several threads at once, in no particular order.
+            template <typename Callable>
+            void ParallelTraverse(Callable callable)
+            {
+                if (!tree)
+                    throw tree_not_exist(__func__);
+                parallel_for_each(*tree, std::move(callable));
+            }
+            // Visits the levels one after another, the elements of each level from several threads at once.
+            template <typename Callable, typename dir_t = left_first_t>
+            void ParallelLevelOrderTraverse(Callable callable, dir_t dir = dir_t{})
+            {
+                if (!tree)
+                    throw tree_not_exist(__func__);
+                parallel_level_order(*tree, std::move(callable), dir);
+            }
+            // Folds transform(element) into init with combine in the given order, reducing subtrees concurrently.
+            // combine has to be associative.
+            template <typename T, typename Combine, typename Transform, typename order_t, typename dir_t = left_first_t>
+            T ParallelReduce(T init, Combine combine, Transform transform, order_t order, dir_t dir = dir_t{}) const
+            {
+                if (!tree)
+                    throw tree_not_exist(__func__);
+                return parallel_reduce(*tree, std::move(init), std::move(combine), std::move(transform), order, dir);
+            }
+
+            template <typename K, typename order_t = preorder_t, typename dir_t = left_first_t>
+            auto get_iterator(K const &key, order_t order = order_t{}, dir_t dir = dir_t{})
             {
-                if(auto iter = std::find(tree->begin(order, dir), tree->end(order, dir), key))
+                if (auto iter = find(*this, key, order, dir))
                     return iter;
                 throw precondition_failed_to_satisfy(__func__);
             }
@@ -341,6 +562,18 @@ namespace ds_exp
                 return tree->end(order, dir);
             }
 
+            // Merkle hash of the tree. Needs hashed_traits or another hash_augment.
+            std::uint64_t Hash() const
+            {
+                if (!tree)
+                    throw tree_not_exist(__func__);
+                return tree->hash();
+            }
+            bool ChangedSince(std::uint64_t old_hash) const
+            {
+                return Hash() != old_hash;
+            }
+
             friend bool operator==(tree_adapter const &lhs, tree_adapter const &rhs)
             {
                 return *lhs.tree == *rhs.tree;
@@ -356,19 +589,244 @@ namespace ds_exp
                 }
                 return out;
             }
+            // Like operator<<, but writes the tree in the binary form of binary_format.hpp. operator>> reads both.
+            friend std::ostream &write_binary(std::ostream &out, tree_adapter const &tree)
+            {
+                if (!tree.tree)
+                    return out << 0 << " ";
+                out << 1 << " ";
+                return write_binary(out, tree.tree.value());
+            }
+            // Writes the tree in the layout mapped_adapter maps.
+            friend std::ostream &write_mapped(std::ostream &out, tree_adapter const &tree)
+            {
+                if (!tree.tree)
+                    throw tree_not_exist(__func__);
+                return write_mapped(out, tree.tree.value());
+            }
+            // The tree is parsed with push_parse while it is read in chunks, so the definition is never held as a
+            // whole. The stream is left just after the closing ']'.
             friend std::istream &operator>>(std::istream &in, tree_adapter &tree)
             {
                 int has_tree = 0;
                 in >> has_tree;
-                if(!has_tree)
-                    tree.tree.reset();
-                else
+                std::optional<tree_type> loaded;
+                if (has_tree && binary_follows(in))
                 {
-                    tree.tree = tree_type{};
-                    in >> tree.tree.value();
+                    loaded.emplace();
+                    read_binary(in, *loaded);
                 }
+                else if (has_tree)
+                {
+                    push_parse<left_first_t, element_type, std::allocator<element_type>, typename traits_type::augment> parser;
+                    // Chunks only take what is already in the buffer of the stream, so the characters after the
+                    // tree can be put back into it.
+                    using traits = std::istream::traits_type;
+                    auto buffer = in.rdbuf();
+                    char chunk[4096];
+                    while (!parser.done())
+                    {
+                        auto available = buffer->in_avail();
+                        if (available <= 0)
+                        {
+                            auto c = buffer->sbumpc();
+                            if (traits::eq_int_type(c, traits::eof()))
+                            {
+                                in.setstate(std::ios::eofbit | std::ios::failbit);
+                                throw unexpected_end();
+                            }
+                            chunk[0] = traits::to_char_type(c);
+                            parser.feed(std::string_view(chunk, 1));
+                            continue;
+                        }
+                        auto size = std::size_t(buffer->sgetn(chunk, std::min<std::streamsize>(available, sizeof chunk)));
+                        auto used = parser.feed(std::string_view(chunk, size));
+                        while (size != used)
+                            buffer->sputbackc(chunk[--size]);
+                    }
+                    auto parsed = parser.get_binary_tree();
+                    loaded = parsed ? std::move(*parsed) : tree_type{};
+                }
+                tree.replace_loaded(std::move(loaded), "operator>>");
                 return in;
             }
+            // Reads what operator<< wrote from a line held in memory, parsing the tree with indexed_parse.
+            friend void assign_element(std::string_view str, tree_adapter &tree)
+            {
+                parse::detail::buffer_reader source(str);
+                std::optional<tree_type> loaded;
+                if (!source.read_char('0'))
+                {
+                    source.force_read_char('1');
+                    auto parsed = indexed_parse<left_first_t, element_type, std::allocator<element_type>, typename traits_type::augment>(
+                        str.substr(source.position())).get_binary_tree();
+                    loaded = parsed ? std::move(*parsed) : tree_type{};
+                }
+                tree.replace_loaded(std::move(loaded), "operator>>");
+            }
+            friend void assign_element(std::string str, tree_adapter &tree)
+            {
+                assign_element(std::string_view(str), tree);
+            }
+
+        private:
+            static auto compare()
+            {
+                return typename traits_type::compare{};
+            }
+            void create(std::optional<tree_type> generated_tree)
+            {
+                if (!generated_tree)
+                    throw parse_failed("CreateBiTree");
+                if constexpr (traits_type::ordered)
+                {
+                    // The definition only lists the elements, they are filed by key.
+                    tree_type sorted;
+                    for (auto &element : tree_iterate(*generated_tree, preorder))
+                    {
+                        if (!avl_insert(sorted, std::move(element), compare()).second)
+                            throw precondition_failed_to_satisfy("CreateBiTree");
+                    }
+                    generated_tree = std::move(sorted);
+                }
+                auto generated_index = index_of(generated_tree, "CreateBiTree");
+                tree = std::move(generated_tree);
+                index = std::move(generated_index);
+            }
+            // Like create, the index is built before anything is replaced, so a duplicate key leaves the adapter as it was.
+            void replace_loaded(std::optional<tree_type> loaded, char const *function)
+            {
+                auto loaded_index = index_of(loaded, function);
+                tree = std::move(loaded);
+                index = std::move(loaded_index);
+            }
+            static std::string_view key_view(element_type const &element)
+            {
+                return get_key(element);
+            }
+            template <typename iter>
+            void add_to_index(iter const &pos)
+            {
+                if constexpr (traits_type::key_index)
+                    index.emplace(key_view(*pos), index_entry{tree_type::handler_of(pos)});
+            }
+            void remove_from_index(element_type const &element)
+            {
+                if constexpr (traits_type::key_index)
+                    index.erase(key_view(element));
+            }
+            // Index of every key in source, failing on a duplicate key.
+            template <typename Tree>
+            static index_type index_of(Tree const &source, char const *function)
+            {
+                index_type built;
+                if constexpr (traits_type::key_index)
+                {
+                    static_assert(std::is_convertible_v<key_type const &, std::string_view>, "Indexed keys have to be viewable as strings.");
+                    if (!source)
+                        return built;
+                    for (auto iter = source->begin(); iter != source->end(); ++iter)
+                    {
+                        if (!built.emplace(key_view(*iter), index_entry{tree_type::handler_of(iter)}).second)
+                            throw precondition_failed_to_satisfy(function);
+                    }
+                }
+                return built;
+            }
+            template <typename Self, typename K, typename order_t, typename dir_t>
+            static auto find(Self &self, K const &key, order_t order, dir_t dir)
+            {
+                if constexpr (traits_type::key_index)
+                {
+                    auto found = self.index.find(std::string_view(key));
+                    return found == self.index.end() ? self.tree->end(order, dir) : self.tree->iterator_to(found->second.node, order, dir);
+                }
+                else if constexpr (traits_type::ordered)
+                    return self.tree->iterator_to(tree_type::handler_of(bst_find(*self.tree, key, compare())), order, dir);
+                else
+                    return std::find(self.tree->begin(order, dir), self.tree->end(order, dir), key);
+            }
+        };
+    }
+
+    inline namespace tree
+    {
+        // Keys and values are stored one after the other, each in its own flat form.
+        template <typename Key, typename Value>
+        struct flat_value<adapter::detail::stored_t<Key, Value>>
+        {
+            using type = adapter::detail::stored_t<flat_value_t<Key>, flat_value_t<Value>>;
+            static void store(adapter::detail::stored_t<Key, Value> const &value, type &flat, detail::string_table &strings)
+            {
+                flat_value<Key>::store(value.key, flat.key, strings);
+                flat_value<Value>::store(value.value, flat.value, strings);
+            }
+            static bool fits(type const &flat, std::string_view strings)
+            {
+                return flat_value<Key>::fits(flat.key, strings) && flat_value<Value>::fits(flat.value, strings);
+            }
+        };
+    }
+
+    inline namespace adapter
+    {
+        // Read-only tree_adapter over a file written by write_mapped. The file is mapped instead of read and only its
+        // header is checked, so opening it takes the same time for any size of tree, and the queries run on the nodes
+        // where they lie in the file. Validate checks the rest of an untrusted file. Text comes back as mapped_string.
+        template <typename Key_t, typename Value_t = null_value_tag>
+        class mapped_adapter
+        {
+            using adapter_type = tree_adapter<Key_t, Value_t>;
+        public:
+            using element_type = typename adapter_type::element_type;
+            using tree_type = mapped_tree<element_type>;
+            using precondition_failed_to_satisfy = typename adapter_type::precondition_failed_to_satisfy;
+
+            explicit mapped_adapter(std::string const &path)
+                : tree(path)
+            {
+            }
+
+            // Throws corrupt_data if a link or a text of the file leads outside of it.
+            void Validate() const
+            {
+                tree.validate();
+            }
+            auto BiTreeEmpty() const
+            {
+                return tree.empty();
+            }
+            auto BiTreeDepth() const
+            {
+                return tree.depth();
+            }
+            auto Root() const
+            {
+                return tree.root();
+            }
+            template <typename K, typename order_t = preorder_t, typename dir_t = left_first_t>
+            auto &Value(K const &key, order_t order = order_t{}, dir_t dir = dir_t{}) const
+            {
+                auto iter = std::find(tree.begin(order, dir), tree.end(order, dir), key);
+                if (!iter)
+                    throw precondition_failed_to_satisfy(__func__);
+                return get_value(*iter);
+            }
+            template <typename Callable, typename order_t, typename dir_t = left_first_t>
+            void Traverse(Callable callable, order_t order, dir_t dir = dir_t{}) const
+            {
+                for (auto &element : tree_iterate(tree, order, dir))
+                    callable(element);
+            }
+            template <typename Callable, typename dir_t = left_first_t>
+            void LevelOrderTraverse(Callable callable, dir_t dir = dir_t{}) const
+            {
+                for (auto &element : level_order(tree, dir))
+                    callable(element);
+            }
+
+        private:
+            tree_type tree;
         };
     }
 }
@@ -0,0 +1,234 @@
+#ifndef INC_201703_TREE_PARALLEL_HPP
+#define INC_201703_TREE_PARALLEL_HPP
+
+#include <algorithm>
+#include <deque>
+#include <optional>
+#include <utility>
+#include <vector>
+#include "binary_tree.hpp"
+#include "parallel.hpp"
+
+namespace ds_exp
+{
+    inline namespace parallel
+    {
+        namespace detail
+        {
+            // A task hands its oldest pending subtree over to the pool every split_grain nodes, so idle
+            // threads can steal large pieces of work while small subtrees stay on the thread that found them.
+            constexpr std::size_t split_grain = 1024;
+            // Elements of one level visited by a single task.
+            constexpr std::size_t level_grain = 1024;
+            // Upper bound of nodes expanded when an ordered reduction cuts the tree into pieces.
+            constexpr std::size_t reduce_split_nodes = 4096;
+
+            template <typename Iter, typename Callable>
+            void visit_subtree(task_group &group, Iter subtree_root, Callable &callable)
+            {
+                std::deque<Iter> pending{subtree_root};
+                for (std::size_t visited = 1; !pending.empty(); ++visited)
+                {
+                    auto iter = pending.back();
+                    pending.pop_back();
+                    callable(*iter);
+                    if (iter.second_child())
+                        pending.push_back(iter.second_child());
+                    if (iter.first_child())
+                        pending.push_back(iter.first_child());
+                    if (visited % split_grain == 0 && pending.size() > 1)
+                    {
+                        auto split = pending.front();
+                        pending.pop_front();
+                        group.run([&group, split, &callable] { visit_subtree(group, split, callable); });
+                    }
+                }
+            }
+
+            // First and last node of the subtree rooted at iter, in the order and direction of Iter.
+            template <typename Iter, typename dir_t>
+            Iter subtree_first(Iter iter, preorder_t, dir_t)
+            {
+                return iter;
+            }
+            template <typename Iter, typename dir_t>
+            Iter subtree_first(Iter iter, inorder_t, dir_t dir)
+            {
+                while (iter.first_child(dir))
+                    iter = iter.first_child(dir);
+                return iter;
+            }
+            template <typename Iter, typename dir_t>
+            Iter subtree_first(Iter iter, postorder_t, dir_t dir)
+            {
+                while (iter.first_child(dir) || iter.second_child(dir))
+                    iter = iter.first_child(dir) ? iter.first_child(dir) : iter.second_child(dir);
+                return iter;
+            }
+            template <typename Iter, typename dir_t>
+            Iter subtree_last(Iter iter, preorder_t, dir_t dir)
+            {
+                while (iter.first_child(dir) || iter.second_child(dir))
+                    iter = iter.second_child(dir) ? iter.second_child(dir) : iter.first_child(dir);
+                return iter;
+            }
+            template <typename Iter, typename dir_t>
+            Iter subtree_last(Iter iter, inorder_t, dir_t dir)
+            {
+                while (iter.second_child(dir))
+                    iter = iter.second_child(dir);
+                return iter;
+            }
+            template <typename Iter, typename dir_t>
+            Iter subtree_last(Iter iter, postorder_t, dir_t)
+            {
+                return iter;
+            }
+
+            // Piece of an ordered reduction: a single node, or a whole subtree reduced sequentially.
+            template <typename Iter>
+            struct reduce_piece
+            {
+                Iter iter;
+                bool whole;
+            };
+            template <typename Iter, typename order_t, typename dir_t>
+            void expand_piece(std::vector<reduce_piece<Iter>> &out, Iter iter, order_t, dir_t dir)
+            {
+                auto push_subtree = [&out](Iter child) {
+                    if (child)
+                        out.push_back({child, true});
+                };
+                if constexpr (std::is_same_v<order_t, preorder_t>)
+                    out.push_back({iter, false});
+                push_subtree(iter.first_child(dir));
+                if constexpr (std::is_same_v<order_t, inorder_t>)
+                    out.push_back({iter, false});
+                push_subtree(iter.second_child(dir));
+                if constexpr (std::is_same_v<order_t, postorder_t>)
+                    out.push_back({iter, false});
+            }
+        }
+
+        // Calls callable on every element of tree, from several threads at once and in no particular order.
+        // Subtrees are forked as tasks on the shared thread_pool and balanced by work stealing.
+        template <typename Tree, typename Callable>
+        void parallel_for_each(Tree &tree, Callable callable)
+        {
+            if (tree.empty())
+                return;
+            auto &pool = thread_pool::shared();
+            if (pool.concurrency() == 1)
+            {
+                for (auto &element : tree_iterate(tree, preorder))
+                    callable(element);
+                return;
+            }
+            task_group group(pool);
+            auto root = tree.root();
+            group.run_and_wait([&group, root, &callable] { detail::visit_subtree(group, root, callable); });
+        }
+
+        // Visits the levels of tree one after another like a level order traversal, the elements of one level
+        // concurrently. Every element is visited after the elements of the levels above it.
+        template <typename Tree, typename Callable, typename dir_t = left_first_t>
+        void parallel_level_order(Tree &tree, Callable callable, dir_t dir = dir_t{})
+        {
+            using iter_type = decltype(tree.root(preorder, dir));
+            if (tree.empty())
+                return;
+            std::vector<iter_type> level{tree.root(preorder, dir)}, next_level;
+            std::vector<std::vector<iter_type>> children;
+            while (!level.empty())
+            {
+                auto chunks = (level.size() + detail::level_grain - 1) / detail::level_grain;
+                children.assign(chunks, {});
+                thread_pool::shared().for_each_index(chunks, [&](std::size_t chunk) {
+                    auto last = std::min(level.size(), (chunk + 1) * detail::level_grain);
+                    for (auto i = chunk * detail::level_grain; i < last; ++i)
+                    {
+                        callable(*level[i]);
+                        if (level[i].first_child(dir))
+                            children[chunk].push_back(level[i].first_child(dir));
+                        if (level[i].second_child(dir))
+                            children[chunk].push_back(level[i].second_child(dir));
+                    }
+                });
+                next_level.clear();
+                for (auto &part : children)
+                    next_level.insert(next_level.end(), part.begin(), part.end());
+                std::swap(level, next_level);
+            }
+        }
+
+        // Returns init combined with transform(element) of every element in the given order, like a sequential
+        // left fold. Disjoint parts of the order are reduced concurrently and their results combined in order,
+        // so combine must be associative but needn't be commutative.
+        template <typename Tree, typename T, typename Combine, typename Transform, typename order_t, typename dir_t = left_first_t>
+        T parallel_reduce(Tree &tree, T init, Combine combine, Transform transform, order_t order, dir_t dir = dir_t{})
+        {
+            using iter_type = decltype(tree.root(order, dir));
+            using piece = detail::reduce_piece<iter_type>;
+            if (tree.empty())
+                return init;
+            auto &pool = thread_pool::shared();
+            auto wanted = pool.concurrency() * 8;
+            auto fold = [&](iter_type current, iter_type end, std::optional<T> &result) {
+                for (; current != end; ++current)
+                {
+                    if (result)
+                        *result = combine(std::move(*result), transform(*current));
+                    else
+                        result.emplace(transform(*current));
+                }
+            };
+            std::vector<std::optional<T>> results;
+            if constexpr (has_augment<typename Tree::node_type, size_augment>)
+            {
+                // Trees keeping subtree sizes are cut into equally long ranges of the order right away.
+                auto size = tree.size();
+                results.resize(std::min(size, wanted));
+                pool.for_each_index(results.size(), [&](std::size_t i) {
+                    fold(tree.nth(i * size / results.size(), order, dir), tree.nth((i + 1) * size / results.size(), order, dir), results[i]);
+                });
+            }
+            else
+            {
+                // Otherwise the tree is cut into single nodes and whole subtrees, expanding subtrees in order
+                // until there are enough of them.
+                std::vector<piece> pieces{{tree.root(order, dir), true}}, expanded;
+                for (std::size_t split = 0; pool.concurrency() > 1 && split < detail::reduce_split_nodes;)
+                {
+                    auto whole = std::count_if(pieces.begin(), pieces.end(), [](piece const &p) { return p.whole; });
+                    if (whole == 0 || std::size_t(whole) >= wanted)
+                        break;
+                    expanded.clear();
+                    for (auto &p : pieces)
+                    {
+                        if (!p.whole)
+                            expanded.push_back(p);
+                        else
+                            detail::expand_piece(expanded, p.iter, order, dir), ++split;
+                    }
+                    std::swap(pieces, expanded);
+                }
+                results.resize(pieces.size());
+                pool.for_each_index(pieces.size(), [&](std::size_t i) {
+                    auto iter = pieces[i].iter;
+                    if (!pieces[i].whole)
+                        results[i].emplace(transform(*iter));
+                    else
+                    {
+                        auto end = detail::subtree_last(iter, order, dir);
+                        fold(detail::subtree_first(iter, order, dir), ++end, results[i]);
+                    }
+                });
+            }
+            for (auto &result : results)
+                init = combine(std::move(init), std::move(*result));
+            return init;
+        }
+    }
+}
+
+#endif //INC_201703_TREE_PARALLEL_HPP
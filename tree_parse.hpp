@@ -1,11 +1,15 @@
 #ifndef INC_201703_TREE_PARSE_HPP
 #define INC_201703_TREE_PARSE_HPP
 
+#include <cctype>
+#include <charconv>
 #include <optional>
 #include <string_view>
 #include <sstream>
 #include <stdexcept>
 #include <functional>
+#include <type_traits>
+#include <vector>
 #include "binary_tree.hpp"
 
 namespace ds_exp
@@ -34,23 +38,6 @@ namespace ds_exp
             {
             }
         };
-        namespace detail
-        {
-            template <typename U>
-            struct final_call
-            {
-                final_call(U c)
-                    : call(c)
-                {
-                }
-                ~final_call()
-                {
-                    call();
-                }
-                U call;
-            };
-        }
-
         template <typename value>
         void assign_element(std::string str, value &v)
         {
@@ -65,6 +52,41 @@ namespace ds_exp
             v = std::move(str);
         }
 
+        namespace detail
+        {
+            template <typename value>
+            constexpr bool parsed_by_from_chars = std::is_arithmetic_v<value> && !std::is_same_v<value, bool> &&
+                                                  !std::is_same_v<value, char> && !std::is_same_v<value, signed char> &&
+                                                  !std::is_same_v<value, unsigned char> && !std::is_same_v<value, wchar_t> &&
+                                                  !std::is_same_v<value, char16_t> && !std::is_same_v<value, char32_t>;
+        }
+        // Elements handed over as slices of a buffer. Numbers are converted with std::from_chars, allowing the
+        // spaces and the leading '+' the stream based conversion accepts; other types go through the std::string
+        // overloads.
+        template <typename value>
+        void assign_element(std::string_view str, value &v)
+        {
+            if constexpr (detail::parsed_by_from_chars<value>)
+            {
+                auto first = str.data(), last = str.data() + str.size();
+                while (first != last && std::isspace(static_cast<unsigned char>(*first)))
+                    ++first;
+                if (last - first > 1 && *first == '+' && first[1] != '-')
+                    ++first;
+                auto [end, error] = std::from_chars(first, last, v);
+                while (end != last && std::isspace(static_cast<unsigned char>(*end)))
+                    ++end;
+                if (error != std::errc() || end != last)
+                    throw parse_failed();
+            }
+            else
+                assign_element(std::string(str), v);
+        }
+        inline void assign_element(std::string_view str, std::string &v)
+        {
+            v.assign(str);
+        }
+
         namespace detail
         {
 
@@ -127,48 +149,175 @@ namespace ds_exp
             }
         }
 
-        template <typename direction, typename T>
-        class tree_parse
+        namespace detail
+        {
+            // The grammar primitives above on a stream, which is left right behind the parsed text.
+            class stream_reader
+            {
+            public:
+                using source_type = std::istream &;
+
+                explicit stream_reader(std::istream &in)
+                    : in(in)
+                {
+                }
+                bool read_char(char c)
+                {
+                    return detail::read_char(in, c);
+                }
+                void force_read_char(char c)
+                {
+                    detail::force_read_char(in, c);
+                }
+                bool read_word(std::string_view word)
+                {
+                    return detail::read_word(in, word);
+                }
+                template <typename ...Stops>
+                std::string read_until(bool skip_backslash, Stops ...stop)
+                {
+                    return detail::read_until(in, skip_backslash, stop...);
+                }
+
+            private:
+                std::istream &in;
+            };
+
+            // The same grammar on a contiguous buffer. Text is scanned in place and read_until returns a slice of
+            // the buffer, unless escapes have to be removed; then the slice is unescaped into a scratch string
+            // that stays valid until the next read_until.
+            class buffer_reader
+            {
+            public:
+                using source_type = std::string_view;
+
+                explicit buffer_reader(std::string_view text)
+                    : text(text)
+                {
+                }
+                void eat_space()
+                {
+                    while (pos != text.size() && std::isspace(static_cast<unsigned char>(text[pos])))
+                        ++pos;
+                }
+                bool read_char(char c)
+                {
+                    eat_space();
+                    if (pos != text.size() && text[pos] == c)
+                        return ++pos, true;
+                    return false;
+                }
+                void force_read_char(char c)
+                {
+                    if (!read_char(c))
+                        throw expect_failed(std::string() + c);
+                }
+                bool read_word(std::string_view word)
+                {
+                    auto recover = pos;
+                    eat_space();
+                    if (text.compare(pos, word.size(), word) == 0)
+                        return pos += word.size(), true;
+                    pos = recover;
+                    return false;
+                }
+                template <typename ...Stops>
+                std::string_view read_until(bool skip_backslash, Stops ...stop)
+                {
+                    auto is_stop = [=](char c) { return ((c == stop) || ...); };
+                    auto escaped = [&](std::size_t i) {
+                        return text[i] == '\\' && i + 1 != text.size() && ((skip_backslash && text[i + 1] == '\\') || is_stop(text[i + 1]));
+                    };
+                    auto start = pos;
+                    while (pos != text.size() && !is_stop(text[pos]) && !escaped(pos))
+                        ++pos;
+                    if (pos == text.size() || is_stop(text[pos]))
+                        return text.substr(start, pos - start);
+                    scratch.assign(text, start, pos - start);
+                    while (pos != text.size() && !is_stop(text[pos]))
+                    {
+                        if (escaped(pos))
+                            ++pos;
+                        scratch.push_back(text[pos++]);
+                    }
+                    return scratch;
+                }
+                // Characters consumed so far.
+                std::size_t position() const
+                {
+                    return pos;
+                }
+
+            protected:
+                std::string_view text;
+                std::size_t pos = 0;
+
+            private:
+                std::string scratch;
+            };
+        }
+
+        // Parses a tree definition like "[(a), (b), null, null, (c), null, null]" from the source of Reader.
+        template <typename Reader, typename direction, typename T, typename Allocator = std::allocator<T>, typename Augment = no_augment>
+        class basic_tree_parse
         {
-            using tree_type = binary_tree<T>;
+            using tree_type = binary_tree<T, Allocator, Augment>;
             using value_type = typename tree_type::value_type;
-            std::istream &source;
+            Reader source;
+            Allocator alloc;
 
         public:
-            explicit tree_parse(std::istream &in)
-                : source(in)
+            explicit basic_tree_parse(typename Reader::source_type in, Allocator const &alloc = Allocator())
+                : source(in), alloc(alloc)
             {
             }
             std::optional<tree_type> get_binary_tree()
             {
-                detail::force_read_char(source, '[');
-                auto _ = detail::final_call{[=]
-                                            { detail::force_read_char(source, ']'); }};
+                source.force_read_char('[');
+                std::optional<tree_type> tree;
                 if (auto element = get_element())
-                {
-                    auto tree = get_subtree(std::move(element.value()));
-                    return tree;
-                } else
-                    return std::nullopt;
+                    tree = get_subtree(std::move(element.value()));
+                source.force_read_char(']');
+                return tree;
+            }
+            Reader const &reader() const
+            {
+                return source;
             }
 
         private:
+            // The nodes still waiting for a child are kept on a heap allocated stack instead of the call stack,
+            // so deeply nested definitions can't overflow it.
             tree_type get_subtree(value_type &&parent_element)
             {
-                tree_type tree;
-                tree.set_root(parent_element);
-                fill_child<direction>(tree);
-                fill_child<typename direction::inverse>(tree);
+                tree_type tree(alloc);
+                tree.set_root(std::move(parent_element));
+                using iter_type = decltype(tree.root());
+                std::vector<std::pair<iter_type, bool>> pending{{tree.root(), false}};
+                while (!pending.empty())
+                {
+                    auto [parent, first_filled] = pending.back();
+                    pending.pop_back();
+                    std::optional<iter_type> child;
+                    if (!first_filled)
+                    {
+                        pending.emplace_back(parent, true);
+                        child = fill_child<direction>(tree, parent);
+                    } else
+                        child = fill_child<typename direction::inverse>(tree, parent);
+                    if (child)
+                        pending.emplace_back(*child, false);
+                }
+                tree.update_augment();
                 return tree;
             }
-            template <typename dir>
-            void fill_child(tree_type &tree)
+            template <typename dir, typename iter>
+            std::optional<iter> fill_child(tree_type &tree, iter parent)
             {
-                detail::force_read_char(source, ',');
+                source.force_read_char(',');
                 if (auto element = get_element())
-                {
-                    tree.replace_child(tree.root(), get_subtree(std::move(element.value())), dir{});
-                }
+                    return tree.new_child(parent, std::move(element.value()), dir{}, defer_update);
+                return std::nullopt;
             }
             std::optional<value_type> get_element()
             {
@@ -179,23 +328,26 @@ namespace ds_exp
             }
             bool is_null()
             {
-                return detail::read_word(source, "null");
+                return source.read_word("null");
             }
 
             value_type read_element()
             {
-                std::string input;
-                if (detail::read_char(source, '('))
+                value_type result;
+                if (source.read_char('('))
                 {
-                    input = detail::read_until(source, false, ')');
-                    detail::force_read_char(source, ')');
+                    assign_element(source.read_until(false, ')'), result);
+                    source.force_read_char(')');
                 } else
-                    input = detail::read_until(source, false, ',', ']');
-                value_type result;
-                assign_element(std::move(input), result);
+                    assign_element(source.read_until(false, ',', ']'), result);
                 return result;
             }
         };
+        template <typename direction, typename T, typename Allocator = std::allocator<T>, typename Augment = no_augment>
+        using tree_parse = basic_tree_parse<detail::stream_reader, direction, T, Allocator, Augment>;
+        // Parses a definition held in memory as a whole, e.g. a string or a mapped file.
+        template <typename direction, typename T, typename Allocator = std::allocator<T>, typename Augment = no_augment>
+        using buffer_parse = basic_tree_parse<detail::buffer_reader, direction, T, Allocator, Augment>;
     }
 
 }